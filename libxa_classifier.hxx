@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define XA_CLASSIFIER_ISA "avx2"
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XA_CLASSIFIER_ISA "sse2"
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define XA_CLASSIFIER_ISA "neon"
+#else
+#define XA_CLASSIFIER_ISA "scalar"
+#endif
+
+// Classifies XA sectors as audio/form2/null/silent without calling memcmp for every sound group.
+// The instruction set is picked at compile time (e.g. -mavx2 or /arch:AVX2 to get the AVX2 kernel).
+class classifier
+{
+public:
+    static constexpr uint8_t NULL_FLAG   = 0x01; // Every sound group header is zero (or submode is 0xFF)
+    static constexpr uint8_t SILENT_FLAG = 0x02; // Every sound group sample data is zero (or submode is 0xFF)
+    static constexpr uint8_t AUDIO_FLAG  = 0x04; // Same bit as the submode AUDIO_MASK
+    static constexpr uint8_t FORM2_FLAG  = 0x08;
+
+    static constexpr const char *isa = XA_CLASSIFIER_ISA;
+
+    // subheader must point to the 2336 bytes XA data of a sector.
+    static uint8_t classify(const uint8_t *subheader)
+    {
+        const uint8_t submode = subheader[2];
+        uint8_t flags = (submode & 0x04) | ((submode & 0x20) != 0 ? FORM2_FLAG : 0); // 0x04 = AUDIO_MASK, 0x20 = FORM2_MASK
+        if (submode == 0xFF)
+            return flags | NULL_FLAG | SILENT_FLAG;
+
+        // Most audio sectors are decided by their first sound group.
+        // Otherwise the rest of the groups are OR-ed together and tested once, without a branch per group.
+        const int groups = (flags & FORM2_FLAG) != 0 ? 18 : 16;
+        const uint8_t *group = subheader + DATA_OFFSET;
+        bool headZero = zeroHeads(group, 1);
+        bool dataZero = zeroData(group, 1);
+        if (headZero)
+            headZero = zeroHeads(group + SOUND_GROUP_SIZE, groups - 1);
+        if (dataZero)
+            dataZero = zeroData(group + SOUND_GROUP_SIZE, groups - 1);
+
+        return flags | (headZero ? NULL_FLAG : 0) | (dataZero ? SILENT_FLAG : 0);
+    }
+
+    // Classifies count sectors of sectorSize (2336 or 2352) bytes stored back to back.
+    static void classify(const uint8_t *sectors, size_t count, const int sectorSize, uint8_t *flags)
+    {
+        const uint8_t *subheader = sectors + sectorSize - XA_DATA_SIZE;
+        for (size_t i = 0; i < count; ++i, subheader += sectorSize)
+            flags[i] = classify(subheader);
+    }
+
+private:
+    static constexpr int XA_DATA_SIZE     = 2336;
+    static constexpr int DATA_OFFSET      = 0x08;
+    static constexpr int SOUND_GROUP_HEAD = 16;
+    static constexpr int SOUND_GROUP_SIZE = 128;
+#if !(defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__ARM_NEON) || defined(_M_ARM64))
+    static constexpr uint8_t emptyGroup[SOUND_GROUP_SIZE - SOUND_GROUP_HEAD]{}; // The scalar fallback is the plain memcmp loop
+#endif
+
+    // True if the 16 bytes headers of count consecutive sound groups are all zero.
+    static bool zeroHeads(const uint8_t *group, const int count)
+    {
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < count; ++i, group += SOUND_GROUP_SIZE)
+            acc = _mm_or_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(group)));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) == 0xFFFF;
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+        uint8x16_t acc = vdupq_n_u8(0);
+        for (int i = 0; i < count; ++i, group += SOUND_GROUP_SIZE)
+            acc = vorrq_u8(acc, vld1q_u8(group));
+        const uint64x2_t acc64 = vreinterpretq_u64_u8(acc);
+        return (vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1)) == 0;
+#else
+        for (int i = 0; i < count; ++i, group += SOUND_GROUP_SIZE)
+        {
+            if (memcmp(group, emptyGroup, SOUND_GROUP_HEAD) != 0)
+                return false;
+        }
+        return true;
+#endif
+    }
+
+    // True if the 112 bytes sample data of count consecutive sound groups are all zero.
+    static bool zeroData(const uint8_t *group, const int count)
+    {
+        const uint8_t *data = group + SOUND_GROUP_HEAD;
+#if defined(__AVX2__)
+        __m256i wide = _mm256_setzero_si256();
+        __m128i tail = _mm_setzero_si128();
+        for (int i = 0; i < count; ++i, data += SOUND_GROUP_SIZE)
+        {
+            wide = _mm256_or_si256(wide, _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data)),
+                                                                         _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32))),
+                                                         _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 64))));
+            tail = _mm_or_si128(tail, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 96)));
+        }
+        return _mm256_testz_si256(wide, wide) && _mm_testz_si128(tail, tail);
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < count; ++i, data += SOUND_GROUP_SIZE)
+        {
+            const __m128i *p = reinterpret_cast<const __m128i *>(data);
+            acc = _mm_or_si128(acc, _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+                                                              _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3))),
+                                                 _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p + 4), _mm_loadu_si128(p + 5)),
+                                                              _mm_loadu_si128(p + 6))));
+        }
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) == 0xFFFF;
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+        uint8x16_t acc = vdupq_n_u8(0);
+        for (int i = 0; i < count; ++i, data += SOUND_GROUP_SIZE)
+        {
+            acc = vorrq_u8(acc, vorrq_u8(vorrq_u8(vorrq_u8(vld1q_u8(data), vld1q_u8(data + 16)),
+                                                  vorrq_u8(vld1q_u8(data + 32), vld1q_u8(data + 48))),
+                                         vorrq_u8(vorrq_u8(vld1q_u8(data + 64), vld1q_u8(data + 80)),
+                                                  vld1q_u8(data + 96))));
+        }
+        const uint64x2_t acc64 = vreinterpretq_u64_u8(acc);
+        return (vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1)) == 0;
+#else
+        for (int i = 0; i < count; ++i, data += SOUND_GROUP_SIZE)
+        {
+            if (memcmp(data, emptyGroup, SOUND_GROUP_SIZE - SOUND_GROUP_HEAD) != 0)
+                return false;
+        }
+        return true;
+#endif
+    }
+};
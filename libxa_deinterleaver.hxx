@@ -6,10 +6,15 @@
 #include <string>
 #endif
 
+#include "libxa_classifier.hxx"
+#include "libxa_iso9660.hxx"
+
 #include <filesystem>
 #include <vector>
 #include <cstring>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 class deinterleaver
 {
@@ -30,16 +35,18 @@ public:
     std::vector<FileInfo> entries;
 
     // inputPath must be an interleaved .xa or .str file. CD image files may have unexpected results.
-    explicit deinterleaver(const std::filesystem::path &inputPath) : inputPath(inputPath)
+    // useCache loads/saves the analysis from/to a sidecar "<inputPath>.xai" file, valid while the input is unchanged.
+    explicit deinterleaver(const std::filesystem::path &inputPath, const bool useCache = true) : inputPath(inputPath), baseName(inputPath.stem()), useCache(useCache)
     {
+        std::unique_ptr<char[]> stdiBuf; // Outlives the file
         std::unique_ptr<FILE, decltype(&fclose)> inputFile(fopen(inputPath.string().c_str(), "rb"), &fclose);
         if (!inputFile)
         {
             fprintf(stderr, "Error: Cannot read \"%s\". %s\n", inputPath.filename().string().c_str(), strerror(errno));
             return;
         }
-        std::unique_ptr<char[]> stdiBuf(new char[STDIO_IOFBF_SIZE]);
-        setvbuf(inputFile.get(), stdiBuf.get(), _IOFBF, STDIO_IOFBF_SIZE);
+        // Unbuffered until the cache misses, so the scattered key samples do not refill a 1MiB buffer each.
+        setvbuf(inputFile.get(), nullptr, _IONBF, 0);
 
         if (fread(buffer + FILENUM_OFFSET, 1, XA_DATA_SIZE, inputFile.get()) != XA_DATA_SIZE)
         {
@@ -48,8 +55,6 @@ public:
             errno = EINVAL;
             return;
         }
-        fseeko(inputFile.get(), 0, SEEK_SET);
-
         const uintmax_t fileSize = std::filesystem::file_size(inputPath);
         if (fileSize % CD_SECTOR_SIZE == 0 && memcmp(buffer + FILENUM_OFFSET, buffer, 12) == 0)
             inputSectorSize = CD_SECTOR_SIZE;
@@ -60,94 +65,245 @@ public:
         offset = CD_SECTOR_SIZE - inputSectorSize;
         const intmax_t totalSectors = fileSize / inputSectorSize;
 
-        intmax_t currentSector = 0;
-        std::vector<bool> processedSectors(totalSectors);
-        printf("Analyzing %s...   0%%", inputPath.filename().string().c_str());
-        while (fread(buffer + offset, 1, inputSectorSize, inputFile.get()) == inputSectorSize)
+        const IndexKey key = useCache ? indexKey(inputFile.get(), totalSectors) : IndexKey{};
+        if (useCache && loadIndex(key))
+            printf("Analyzing %s... Cached\n", inputPath.filename().string().c_str());
+        else
         {
-            if (!isAudio() || isNull())
+            // setvbuf must come before any other operation on the stream
+            inputFile.reset(fopen(inputPath.string().c_str(), "rb"));
+            if (!inputFile)
             {
-                currentSector++;
-                continue;
+                fprintf(stderr, "Error: Cannot read \"%s\". %s\n", inputPath.filename().string().c_str(), strerror(errno));
+                return;
             }
+            stdiBuf.reset(new char[STDIO_IOFBF_SIZE]);
+            setvbuf(inputFile.get(), stdiBuf.get(), _IOFBF, STDIO_IOFBF_SIZE);
 
-            // Skip sectors that has already been processed.
-            if (processedSectors[currentSector])
-            {
-                auto nextUnprocessed = std::find(processedSectors.begin() + currentSector, processedSectors.end(), false);
-                currentSector = std::distance(processedSectors.begin(), nextUnprocessed);
-                fseeko(inputFile.get(), currentSector * inputSectorSize, SEEK_SET);
-                continue;
-            }
+            printf("Analyzing %s...   0%%", inputPath.filename().string().c_str());
+            sectors = index(inputFile.get(), totalSectors);
+            printf("\b\b\b\b100%%\n");
 
-            printf("\b\b\b\b%3jd%%", (currentSector * 100) / totalSectors);
-            currentSector = parse(inputFile.get(), currentSector, processedSectors);
+            analyze();
+            if (useCache)
+                saveIndex(key);
         }
-        printf("\b\b\b\b100%%\n");
 
         if (entries.empty())
             printf("No valid entries found.\n");
-        else
+    }
+
+    // imagePath must be the 2352 bytes CD image where iso9660 found the extent.
+    // Only the sectors of the extent are analyzed. Sector numbers stay absolute in the image and the analysis is not cached.
+    explicit deinterleaver(const std::filesystem::path &imagePath, const iso9660::Extent &extent)
+        : inputPath(imagePath), baseName(std::filesystem::u8path(extent.filePath).stem()), useCache(false), firstSec(extent.begSec)
+    {
+        std::unique_ptr<char[]> stdiBuf(new char[STDIO_IOFBF_SIZE]); // Outlives the file
+        std::unique_ptr<FILE, decltype(&fclose)> inputFile(fopen(imagePath.string().c_str(), "rb"), &fclose);
+        if (!inputFile)
         {
-            std::string namePrefix = inputPath.stem().u8string() + "_";
-            size_t namePadWidth = std::max<size_t>(std::to_string(entries.size() - 1).length(), 2);
-            for (FileInfo &entry : entries)
-                entry.fileName = namePrefix + std::string(namePadWidth - entry.fileName.length(), '0') + std::move(entry.fileName) + ".xa";
+            fprintf(stderr, "Error: Cannot read \"%s\". %s\n", imagePath.filename().string().c_str(), strerror(errno));
+            return;
         }
+        setvbuf(inputFile.get(), stdiBuf.get(), _IOFBF, STDIO_IOFBF_SIZE);
+        inputSectorSize = CD_SECTOR_SIZE;
+
+        fseeko(inputFile.get(), static_cast<int64_t>(firstSec) * inputSectorSize, SEEK_SET);
+        printf("Analyzing %s...   0%%", extent.filePath.c_str());
+        sectors = index(inputFile.get(), extent.sectorCount);
+        printf("\b\b\b\b100%%\n");
+
+        analyze();
+        if (entries.empty())
+            printf("No valid entries found.\n");
     }
     virtual ~deinterleaver() = default;
 
     // outputDir must be a directory (not a file).
     // sectorSize must be 2336 or 2352 to change the output size.
-    void deinterleave(const std::filesystem::path &outputDir, int sectorSize = 0)
+    // jobs is the number of entries written at the same time. 0 uses all the hardware threads.
+    // Returns false if a file could not be read or written.
+    bool deinterleave(const std::filesystem::path &outputDir, int sectorSize = 0, int jobs = 1)
     {
         if (entries.empty())
-            return;
+            return true;
 
         if (sectorSize == 0)
             sectorSize = inputSectorSize;
-        const int outOffset = CD_SECTOR_SIZE - sectorSize;
+        if (jobs <= 0)
+            jobs = std::max<int>(std::thread::hardware_concurrency(), 1);
+        jobs = std::min<int>(jobs, entries.size());
+
+        if (jobs > 1)
+        {
+            if (!std::filesystem::exists(outputDir))
+                std::filesystem::create_directories(outputDir);
+
+            // Each worker takes the next entry and reads it through its own input handle.
+            std::atomic<size_t> nextEntry = 0;
+            std::atomic<bool> failed = false;
+            std::atomic<int> error = 0; // errno is per thread
+            std::vector<std::thread> workers;
+            for (int i = 0; i < jobs; ++i)
+            {
+                workers.emplace_back([&]() -> void
+                {
+                    // The buffers outlive the files, which are flushed on close
+                    std::unique_ptr<char[]> stdiBuf(new char[STDIO_IOFBF_SIZE]);
+                    std::unique_ptr<char[]> stdoBuf(new char[STDIO_IOFBF_SIZE]);
+                    std::unique_ptr<FILE, decltype(&fclose)> inputFile(fopen(inputPath.string().c_str(), "rb"), &fclose);
+                    if (!inputFile)
+                    {
+                        error = errno;
+                        failed = true;
+                        fprintf(stderr, "Error: Cannot read \"%s\". %s\n", inputPath.filename().string().c_str(), strerror(error));
+                        return;
+                    }
+                    setvbuf(inputFile.get(), stdiBuf.get(), _IOFBF, STDIO_IOFBF_SIZE);
+
+                    for (size_t index; !failed && (index = nextEntry++) < entries.size();)
+                    {
+                        if (!extract(entries[index], inputFile.get(), stdoBuf.get(), outputDir, sectorSize))
+                        {
+                            error = errno;
+                            failed = true;
+                        }
+                    }
+                });
+            }
+            for (std::thread &worker : workers)
+                worker.join();
+
+            if (failed)
+            {
+                errno = error != 0 ? error.load() : EIO;
+                return false;
+            }
+            return createManifest(outputDir, baseName.string() + ".csv", sectorSize == XA_DATA_SIZE ? "xa" : "xacd");
+        }
+        const int headSize = std::max(sectorSize - inputSectorSize, 0);
+        const int skipSize = std::max(inputSectorSize - sectorSize, 0);
 
         if (!std::filesystem::exists(outputDir))
             std::filesystem::create_directories(outputDir);
 
-        std::unique_ptr<char[]> stdiBuf(new char[STDIO_IOFBF_SIZE]);
-        std::unique_ptr<char[]> stdoBuf(new char[STDIO_IOFBF_SIZE]);
-
         std::unique_ptr<FILE, decltype(&fclose)> inputFile(fopen(inputPath.string().c_str(), "rb"), &fclose);
-        setvbuf(inputFile.get(), stdiBuf.get(), _IOFBF, STDIO_IOFBF_SIZE);
+        if (!inputFile)
+        {
+            fprintf(stderr, "Error: Cannot read \"%s\". %s\n", inputPath.filename().string().c_str(), strerror(errno));
+            return false;
+        }
+        setvbuf(inputFile.get(), nullptr, _IONBF, 0);
 
+        // Entries are opened when the sweep reaches their first sector, so they are visited by begSec.
+        std::vector<const FileInfo *> pending;
         for (const FileInfo &entry : entries)
+            pending.push_back(&entry);
+        std::stable_sort(pending.begin(), pending.end(), [](const FileInfo *a, const FileInfo *b) { return a->begSec < b->begSec; });
+
+        struct Output
+        {
+            const FileInfo *entry;
+            FILE *outputFile;
+            std::unique_ptr<char[]> stdoBuf;
+            intmax_t nextSec;
+            int chunkPos;
+        };
+        std::vector<Output> outputs;
+        auto closeOutput = [&outputs](size_t index) -> void
+        {
+            fclose(outputs[index].outputFile);
+            printf("Deinterleaving %s... Done\n", outputs[index].entry->fileName.c_str());
+            outputs[index] = std::move(outputs.back());
+            outputs.pop_back();
+        };
+
+        // Single sequential sweep of the input. Every sector is appended to the output(s) that own it.
+        std::unique_ptr<uint8_t[]> block(new uint8_t[DEMUX_BLOCK_SECTORS * inputSectorSize]);
+        // The sweep starts at the first entry, which skips everything before it (e.g. the rest of a CD image).
+        size_t nextPending = 0;
+        intmax_t curSec = pending.front()->begSec;
+        fseeko(inputFile.get(), static_cast<int64_t>(curSec) * inputSectorSize, SEEK_SET);
+        size_t readSectors;
+        while ((nextPending < pending.size() || !outputs.empty()) &&
+               (readSectors = fread(block.get(), inputSectorSize, DEMUX_BLOCK_SECTORS, inputFile.get())) > 0)
         {
-            FILE *outputFile = fopen((outputDir / std::filesystem::u8path(entry.fileName)).string().c_str(), "wb");
-            if (!outputFile)
+            for (size_t s = 0; s < readSectors; ++s, ++curSec)
             {
-                fprintf(stderr, "Error: Cannot write \"%s\". %s\n", entry.fileName.c_str(), strerror(errno));
-                return;
+                for (; nextPending < pending.size() && pending[nextPending]->begSec == curSec; ++nextPending)
+                {
+                    const FileInfo &entry = *pending[nextPending];
+                    FILE *outputFile = fopen((outputDir / std::filesystem::u8path(entry.fileName)).string().c_str(), "wb");
+                    if (!outputFile)
+                    {
+                        fprintf(stderr, "Error: Cannot write \"%s\". %s\n", entry.fileName.c_str(), strerror(errno));
+                        for (const Output &output : outputs)
+                            fclose(output.outputFile);
+                        return false;
+                    }
+                    std::unique_ptr<char[]> stdoBuf(new char[DEMUX_IOFBF_SIZE]);
+                    setvbuf(outputFile, stdoBuf.get(), _IOFBF, DEMUX_IOFBF_SIZE);
+                    outputs.push_back({&entry, outputFile, std::move(stdoBuf), curSec, 0});
+                }
+
+                const uint8_t *sector = block.get() + s * inputSectorSize;
+                for (size_t i = 0; i < outputs.size();)
+                {
+                    Output &output = outputs[i];
+                    if (output.nextSec != curSec)
+                    {
+                        ++i;
+                        continue;
+                    }
+
+                    if (headSize > 0)
+                        fwrite(buffer, 1, headSize, output.outputFile); // Sync and header template
+                    fwrite(sector + skipSize, 1, sectorSize - headSize, output.outputFile);
+
+                    // Same walk as the stride pattern: sectorChunk sectors, then a gap of sectorStride sectors.
+                    const FileInfo &entry = *output.entry;
+                    if (++output.nextSec > entry.endSec || ++output.chunkPos == entry.sectorChunk)
+                    {
+                        output.chunkPos = 0;
+                        output.nextSec += entry.sectorStride;
+                    }
+
+                    if (output.nextSec > entry.endSec)
+                        closeOutput(i);
+                    else
+                        ++i;
+                }
             }
-            else
-                printf("Deinterleaving %s... ", entry.fileName.c_str());
-            setvbuf(outputFile, stdoBuf.get(), _IOFBF, STDIO_IOFBF_SIZE);
+        }
+        while (!outputs.empty())
+            closeOutput(outputs.size() - 1);
 
-            int curSec = entry.begSec;
-            fseeko(inputFile.get(), static_cast<int64_t>(curSec) * inputSectorSize, SEEK_SET);
-            do {
-                int i = 0;
-                do {
-                    if (fread(buffer + offset, 1, inputSectorSize, inputFile.get()) != inputSectorSize)
-                        goto END;
+        return createManifest(outputDir, baseName.string() + ".csv", sectorSize == XA_DATA_SIZE ? "xa" : "xacd");
+    }
 
-                    fwrite(buffer + outOffset, 1, sectorSize, outputFile);
-                } while (++curSec <= entry.endSec && ++i < entry.sectorChunk);
-                fseeko(inputFile.get(), entry.sectorStride * inputSectorSize, SEEK_CUR);
-            } while ((curSec += entry.sectorStride) <= entry.endSec);
+    // Updates the cached state of a sector after it was rewritten in place.
+    // subheader must point to the 2336 bytes XA data that were written.
+    void refreshSector(intmax_t sector, const uint8_t *subheader)
+    {
+        sector -= firstSec;
+        if (sector < 0 || sector >= static_cast<intmax_t>(sectors.size()))
+            return;
+        sectors[sector] = {subheader[0], subheader[1], subheader[2], subheader[3], classifier::classify(subheader)};
+    }
 
-        END:
-            fclose(outputFile);
-            printf("Done\n");
-        }
+    // Rebuilds entries from the refreshed sectors and saves them to the sidecar index.
+    // The input file must have been flushed (or closed) before.
+    void refreshIndex()
+    {
+        analyze();
+        if (!useCache)
+            return;
 
-        createManifest(outputDir, inputPath.stem().string() + ".csv", sectorSize == XA_DATA_SIZE ? "xa" : "xacd");
+        std::unique_ptr<FILE, decltype(&fclose)> inputFile(fopen(inputPath.string().c_str(), "rb"), &fclose);
+        if (!inputFile)
+            return;
+        setvbuf(inputFile.get(), nullptr, _IONBF, 0);
+        saveIndex(indexKey(inputFile.get(), sectors.size()));
     }
 
 protected:
@@ -161,49 +317,263 @@ protected:
 private:
     int offset = 0;
     const std::filesystem::path inputPath;
-    static constexpr int SOUND_GROUP_HEAD = 16;
-    static constexpr int SOUND_GROUP_SIZE = 128;
+    const std::filesystem::path baseName; // Prefix of the entry names and name of the manifest
+    const bool useCache;
+    const intmax_t firstSec = 0; // First analyzed sector of the input, for CD image extents
     static constexpr int STDIO_IOFBF_SIZE = 1024 * 1024; // 1MiB
 
     uint8_t buffer[CD_SECTOR_SIZE] {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x02};
-    uint8_t emptyBuffer[SOUND_GROUP_SIZE - SOUND_GROUP_HEAD]{};
 
-    bool isSilent() const
+    // Copies a single entry from the input handle of the calling worker, so it can run alongside other entries.
+    // stdoBuf is the output buffer of that worker, reused by each of its entries.
+    bool extract(const FileInfo &entry, FILE *inputFile, char *stdoBuf, const std::filesystem::path &outputDir, const int sectorSize) const
+    {
+        std::unique_ptr<FILE, decltype(&fclose)> outputFile(fopen((outputDir / std::filesystem::u8path(entry.fileName)).string().c_str(), "wb"), &fclose);
+        if (!outputFile)
+        {
+            fprintf(stderr, "Error: Cannot write \"%s\". %s\n", entry.fileName.c_str(), strerror(errno));
+            return false;
+        }
+        setvbuf(outputFile.get(), stdoBuf, _IOFBF, STDIO_IOFBF_SIZE);
+
+        uint8_t sectorBuf[CD_SECTOR_SIZE];
+        memcpy(sectorBuf, buffer, FILENUM_OFFSET); // Sync and header template
+        const int outOffset = CD_SECTOR_SIZE - sectorSize;
+
+        int curSec = entry.begSec;
+        fseeko(inputFile, static_cast<int64_t>(curSec) * inputSectorSize, SEEK_SET);
+        do {
+            int i = 0;
+            do {
+                if (fread(sectorBuf + offset, 1, inputSectorSize, inputFile) != static_cast<size_t>(inputSectorSize))
+                    goto END;
+
+                fwrite(sectorBuf + outOffset, 1, sectorSize, outputFile.get());
+            } while (++curSec <= entry.endSec && ++i < entry.sectorChunk);
+            fseeko(inputFile, static_cast<int64_t>(entry.sectorStride) * inputSectorSize, SEEK_CUR);
+        } while ((curSec += entry.sectorStride) <= entry.endSec);
+
+    END:
+        printf("Deinterleaving %s... Done\n", entry.fileName.c_str());
+        return true;
+    }
+
+    struct SectorInfo
+    {
+        uint8_t filenum;
+        uint8_t channel;
+        uint8_t submode;
+        uint8_t codinginfo;
+        uint8_t flags;
+    };
+    static constexpr int INDEX_BLOCK_SECTORS = 448; // ~1MiB of 2336/2352 sectors
+    static constexpr int DEMUX_BLOCK_SECTORS = 448; // ~1MiB of 2336/2352 sectors
+    static constexpr int DEMUX_IOFBF_SIZE    = 64 * 1024; // 64KiB per open output
+
+    std::vector<SectorInfo> sectors;
+
+    // Finds the entries over the sector index.
+    void analyze()
     {
-        return isNull(sizeof(emptyBuffer));
+        entries.clear();
+
+        intmax_t currentSector = 0;
+        std::vector<bool> processedSectors(sectors.size());
+        while (currentSector < static_cast<intmax_t>(sectors.size()))
+        {
+            const SectorInfo &sector = sectors[currentSector];
+            if (!(sector.flags & classifier::AUDIO_FLAG) || (sector.flags & classifier::NULL_FLAG))
+            {
+                currentSector++;
+                continue;
+            }
+
+            // Skip sectors that has already been processed.
+            if (processedSectors[currentSector])
+            {
+                auto nextUnprocessed = std::find(processedSectors.begin() + currentSector, processedSectors.end(), false);
+                currentSector = std::distance(processedSectors.begin(), nextUnprocessed);
+                continue;
+            }
+
+            currentSector = parse(sectors, currentSector, processedSectors);
+        }
+
+        if (!entries.empty())
+        {
+            std::string namePrefix = baseName.u8string() + "_";
+            size_t namePadWidth = std::max<size_t>(std::to_string(entries.size() - 1).length(), 2);
+            for (FileInfo &entry : entries)
+            {
+                entry.fileName = namePrefix + std::string(namePadWidth - entry.fileName.length(), '0') + std::move(entry.fileName) + ".xa";
+                entry.begSec += firstSec;
+                entry.endSec += firstSec;
+            }
+        }
     }
 
-    bool isNull(const int bytes = SOUND_GROUP_HEAD) const
+    struct IndexKey
     {
-        if (buffer[SUBMODE_OFFSET] == 0xFF)
-            return true;
-        
-        int groups = ((buffer[SUBMODE_OFFSET] & 0x20) != 0 ? 18 : 16) * SOUND_GROUP_SIZE; // 0x20 = FORM2_MASK
-        for (int i = bytes != SOUND_GROUP_HEAD ? 0x28 : 0x18; i < groups; i += SOUND_GROUP_SIZE) // 0x28/0x18 = DATA_OFFSET
+        uint64_t fileSize;
+        int64_t mtime;
+        uint64_t fingerprint;
+    };
+    static constexpr char INDEX_MAGIC[4] = {'X', 'A', 'I', '2'};
+    static constexpr int INDEX_SAMPLES   = 64;
+
+    std::filesystem::path indexPath() const
+    {
+        return std::filesystem::path(inputPath) += ".xai";
+    }
+
+    // Size, modification time and a FNV-1a hash of the subheaders of evenly spaced sectors.
+    IndexKey indexKey(FILE *inputFile, const intmax_t totalSectors) const
+    {
+        std::error_code ec;
+        IndexKey key{static_cast<uint64_t>(totalSectors) * inputSectorSize,
+                     static_cast<int64_t>(std::filesystem::last_write_time(inputPath, ec).time_since_epoch().count()),
+                     0xCBF29CE484222325};
+
+        uint8_t subheader[8];
+        for (int i = 0; i < INDEX_SAMPLES && totalSectors > 0; ++i)
+        {
+            const intmax_t sector = totalSectors * i / INDEX_SAMPLES;
+            fseeko(inputFile, static_cast<int64_t>(sector) * inputSectorSize + inputSectorSize - XA_DATA_SIZE, SEEK_SET);
+            if (fread(subheader, 1, sizeof(subheader), inputFile) != sizeof(subheader))
+                break;
+            for (uint8_t byte : subheader)
+                key.fingerprint = (key.fingerprint ^ byte) * 0x100000001B3;
+        }
+        return key;
+    }
+
+    // Sidecar layout: magic, key, inputSectorSize, entries, sector index. Native endianness.
+    bool loadIndex(const IndexKey &key)
+    {
+        const int savedErrno = errno;
+        std::unique_ptr<FILE, decltype(&fclose)> indexFile(fopen(indexPath().string().c_str(), "rb"), &fclose);
+        errno = savedErrno;
+        if (!indexFile)
+            return false;
+
+        auto get = [&indexFile](auto &value) -> bool { return fread(&value, sizeof(value), 1, indexFile.get()) == 1; };
+
+        char magic[sizeof(INDEX_MAGIC)];
+        IndexKey cached;
+        int cachedSectorSize;
+        uint32_t entryCount;
+        if (!get(magic) || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+            !get(cached.fileSize) || !get(cached.mtime) || !get(cached.fingerprint) ||
+            cached.fileSize != key.fileSize || cached.mtime != key.mtime || cached.fingerprint != key.fingerprint ||
+            !get(cachedSectorSize) || cachedSectorSize != inputSectorSize || !get(entryCount))
+            return false;
+
+        std::vector<FileInfo> cachedEntries(entryCount);
+        for (FileInfo &entry : cachedEntries)
         {
-            if (memcmp(buffer + i, emptyBuffer, bytes) != 0)
+            uint16_t nameLength;
+            if (!get(nameLength))
+                return false;
+            entry.fileName.resize(nameLength);
+            if (fread(entry.fileName.data(), 1, nameLength, indexFile.get()) != nameLength ||
+                !get(entry.sectorChunk) || !get(entry.sectorCount) || !get(entry.sectorStride) || !get(entry.nullTrailing) ||
+                !get(entry.filenum) || !get(entry.channel) || !get(entry.nullSubheader) || !get(entry.begSec) || !get(entry.endSec))
                 return false;
         }
+
+        std::vector<SectorInfo> cachedSectors(key.fileSize / inputSectorSize);
+        if (fread(cachedSectors.data(), sizeof(SectorInfo), cachedSectors.size(), indexFile.get()) != cachedSectors.size())
+            return false;
+
+        entries = std::move(cachedEntries);
+        sectors = std::move(cachedSectors);
         return true;
     }
 
-    bool isAudio() const
+    // A failed save only means the next run analyzes the input again.
+    void saveIndex(const IndexKey &key) const
     {
-        return buffer[SUBMODE_OFFSET] & 0x04; // 0x04 = AUDIO_MASK
+        const int savedErrno = errno;
+        const std::filesystem::path path = indexPath();
+        std::unique_ptr<FILE, decltype(&fclose)> indexFile(fopen(path.string().c_str(), "wb"), &fclose);
+        if (!indexFile)
+        {
+            errno = savedErrno;
+            return;
+        }
+
+        auto put = [&indexFile](const auto &value) -> void { fwrite(&value, sizeof(value), 1, indexFile.get()); };
+
+        put(INDEX_MAGIC);
+        put(key.fileSize);
+        put(key.mtime);
+        put(key.fingerprint);
+        put(inputSectorSize);
+        put(static_cast<uint32_t>(entries.size()));
+        for (const FileInfo &entry : entries)
+        {
+            put(static_cast<uint16_t>(entry.fileName.size()));
+            fwrite(entry.fileName.data(), 1, entry.fileName.size(), indexFile.get());
+            put(entry.sectorChunk);
+            put(entry.sectorCount);
+            put(entry.sectorStride);
+            put(entry.nullTrailing);
+            put(entry.filenum);
+            put(entry.channel);
+            put(entry.nullSubheader);
+            put(entry.begSec);
+            put(entry.endSec);
+        }
+        fwrite(sectors.data(), sizeof(SectorInfo), sectors.size(), indexFile.get());
+
+        if (fflush(indexFile.get()) != 0 || ferror(indexFile.get()))
+        {
+            std::error_code ec;
+            indexFile.reset();
+            std::filesystem::remove(path, ec);
+        }
+        errno = savedErrno;
     }
 
-    intmax_t parse(FILE *inputFile, intmax_t currentSector, std::vector<bool> &processedSectors)
+    // Reads totalSectors of the input once, sequentially, and keeps only the subheader and classifier flags of each sector.
+    std::vector<SectorInfo> index(FILE *inputFile, const intmax_t totalSectors)
     {
+        std::vector<SectorInfo> sectors;
+        sectors.reserve(totalSectors);
+        std::unique_ptr<uint8_t[]> block(new uint8_t[INDEX_BLOCK_SECTORS * inputSectorSize]);
+        uint8_t flags[INDEX_BLOCK_SECTORS];
+
+        size_t readSectors;
+        while (static_cast<intmax_t>(sectors.size()) < totalSectors &&
+               (readSectors = fread(block.get(), inputSectorSize, std::min<intmax_t>(INDEX_BLOCK_SECTORS, totalSectors - sectors.size()), inputFile)) > 0)
+        {
+            classifier::classify(block.get(), readSectors, inputSectorSize, flags);
+            for (size_t i = 0; i < readSectors; ++i)
+            {
+                // Point to the XA subheader, wherever the input sector starts.
+                const uint8_t *subheader = block.get() + i * inputSectorSize + inputSectorSize - XA_DATA_SIZE;
+                sectors.push_back({subheader[0], subheader[1], subheader[2], subheader[3], flags[i]});
+            }
+            printf("\b\b\b\b%3jd%%", static_cast<intmax_t>(sectors.size() * 100 / totalSectors));
+        }
+        return sectors;
+    }
+
+    intmax_t parse(const std::vector<SectorInfo> &sectors, intmax_t currentSector, std::vector<bool> &processedSectors)
+    {
+        const intmax_t totalSectors = sectors.size();
+        const SectorInfo *sector = &sectors[currentSector];
+
         FileInfo entry{};
         entry.sectorCount++;
-        entry.filenum = buffer[FILENUM_OFFSET];
-        entry.channel = buffer[CHANNEL_OFFSET];
+        entry.filenum = sector->filenum;
+        entry.channel = sector->channel;
         entry.begSec  = currentSector;
 
-        int skipSize;
         int chunksRead = 0;
-        bool eof = buffer[SUBMODE_OFFSET] & 0x80; // 0x80 = EOF_MASK
-        bool silent = isSilent();
+        intmax_t lastSec = currentSector; // Last sector with data, the null trailing may end mid-chunk
+        bool eof = sector->submode & 0x80; // 0x80 = EOF_MASK
+        bool silent = sector->flags & classifier::SILENT_FLAG;
         do {
             //entry.endSec = currentSector;
             processedSectors[currentSector++] = true;
@@ -218,72 +588,74 @@ private:
                 {
                     chunksRead = 0;
                     currentSector += entry.sectorStride;
-                    if (currentSector >= processedSectors.size() || processedSectors[currentSector])
+                    if (currentSector >= totalSectors || processedSectors[currentSector])
                         goto END;
-
-                    fseeko(inputFile, skipSize, SEEK_CUR);
                 }
-                if (fread(buffer + offset, 1, inputSectorSize, inputFile) != inputSectorSize)
+                if (currentSector >= totalSectors)
                     goto END;
+                sector = &sectors[currentSector];
             }
             else
             {
-                if (fread(buffer + offset, 1, inputSectorSize, inputFile) != inputSectorSize)
+                if (currentSector >= totalSectors)
                     goto END;
+                sector = &sectors[currentSector];
 
                 // Checks if the current sector has already been processed or has different channel/submode.
-                auto isStrideSector = [&]() -> bool { return processedSectors[currentSector] || entry.channel != buffer[CHANNEL_OFFSET] || !isAudio(); };
+                auto isStrideSector = [&]() -> bool { return processedSectors[currentSector] || entry.channel != sector->channel || !(sector->flags & classifier::AUDIO_FLAG); };
 
                 if (entry.sectorCount < 32 && !eof && isStrideSector())
                 {
                     entry.sectorChunk = entry.sectorCount;
 
-                    // Calculate sectorStride and skipSize
+                    // Calculate sectorStride
                     do {
                         currentSector++;
                         entry.sectorStride++;
-                        if (fread(buffer + offset, 1, inputSectorSize, inputFile) != inputSectorSize)
+                        if (currentSector >= totalSectors)
                             goto END;
+                        sector = &sectors[currentSector];
 
                     } while (isStrideSector());
-                    skipSize = entry.sectorStride * inputSectorSize;
                 }
             }
 
-            if (entry.filenum != buffer[FILENUM_OFFSET])
+            const bool null = sector->flags & classifier::NULL_FLAG;
+            if (entry.filenum != sector->filenum)
                 goto END;
             else if (entry.nullTrailing > 0)
             {
-                if (entry.nullSubheader[1] == buffer[CHANNEL_OFFSET] && (entry.nullSubheader[2] | 0x80) == (buffer[SUBMODE_OFFSET] | 0x80) && isNull())
+                if (entry.nullSubheader[1] == sector->channel && (entry.nullSubheader[2] | 0x80) == (sector->submode | 0x80) && null)
                     entry.nullTrailing++;
                 else
                     goto END;
             }
-            else if (isNull())
+            else if (null)
             {
                 entry.nullTrailing++;
-                memcpy(&entry.nullSubheader, &buffer[FILENUM_OFFSET], sizeof(entry.nullSubheader));
+                entry.nullSubheader[0] = sector->filenum;
+                entry.nullSubheader[1] = sector->channel;
+                entry.nullSubheader[2] = sector->submode;
+                entry.nullSubheader[3] = sector->codinginfo;
             }
-            else if (eof || entry.channel != buffer[CHANNEL_OFFSET])
+            else if (eof || entry.channel != sector->channel)
                 goto END;
             else
             {
                 entry.sectorCount++;
-                eof = buffer[SUBMODE_OFFSET] & 0x80; // 0x80 = EOF_MASK
+                lastSec = currentSector;
+                eof = sector->submode & 0x80; // 0x80 = EOF_MASK
                 if (silent)
-                    silent = isSilent();
+                    silent = sector->flags & classifier::SILENT_FLAG;
             }
         } while (true);
 
     END:
-        const int nullSectors = entry.nullTrailing / entry.sectorChunk * entry.sectorStride + entry.nullTrailing;
-        entry.endSec = currentSector - entry.sectorStride - nullSectors - 1;
+        entry.endSec = lastSec;
 
         if (entry.sectorStride > 0)
             currentSector = entry.begSec + 1;
 
-        fseeko(inputFile, currentSector * inputSectorSize, SEEK_SET);
-
         // Skip silence-only files.
         if (silent)
             return currentSector;
@@ -294,13 +666,13 @@ private:
     }
 
     // Virtual function to fill the manifest as needed.
-    virtual void createManifest(const std::filesystem::path &outputDir, const std::string &fileName, const char *type)
+    virtual bool createManifest(const std::filesystem::path &outputDir, const std::string &fileName, const char *type)
     {
         FILE *manifest = fopen((outputDir / fileName).string().c_str(), "wb");
         if (!manifest)
         {
             fprintf(stderr, "Error: Cannot write manifest \"%s\". %s\n", fileName.c_str(), strerror(errno));
-            return;
+            return false;
         }
 
         fprintf(manifest, "chunk,type,file,null_trailing,xa_file_number,xa_channel_number" /*",xa_null_subheader"*/ ",sector_beg-end,stride\n");
@@ -312,5 +684,6 @@ private:
                     entry.begSec, entry.endSec, entry.sectorChunk + entry.sectorStride);
         }
         fclose(manifest);
+        return true;
     }
 };
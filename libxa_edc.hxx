@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// Regenerates the EDC (and the ECC P/Q parity for Form 1) of Mode 2 XA sectors.
+// Layouts are from ECMA-130. Mode 2 ECC is computed with a zeroed header, so it only depends on the XA data.
+class edc
+{
+public:
+    // subheader must point to the 2336 bytes XA data of a Mode 2 sector.
+    static void regenerate(uint8_t *subheader)
+    {
+        if ((subheader[2] & 0x20) != 0) // 0x20 = FORM2_MASK
+        {
+            putLE32(subheader + FORM2_EDC_OFFSET, crc(subheader, FORM2_EDC_OFFSET));
+            return;
+        }
+        putLE32(subheader + FORM1_EDC_OFFSET, crc(subheader, FORM1_EDC_OFFSET));
+
+        // P and Q run over the header (zeroed), subheader, user data and EDC. Q also covers P.
+        uint8_t block[ECC_HEADER_SIZE + FORM1_EDC_OFFSET + 4 + ECC_P_SIZE];
+        memset(block, 0, ECC_HEADER_SIZE);
+        memcpy(block + ECC_HEADER_SIZE, subheader, FORM1_EDC_OFFSET + 4);
+        computeBlock(block, 86, 24, 2, 86, block + ECC_P_OFFSET);
+        memcpy(subheader + ECC_P_OFFSET - ECC_HEADER_SIZE, block + ECC_P_OFFSET, ECC_P_SIZE);
+        computeBlock(block, 52, 43, 86, 88, subheader + ECC_Q_OFFSET - ECC_HEADER_SIZE);
+    }
+
+    // EDC CRC32 (polynomial 0xD8018001 reflected, no final xor), eight bytes per step.
+    static uint32_t crc(const uint8_t *data, size_t size, uint32_t edc = 0)
+    {
+        for (; size >= 8; size -= 8, data += 8)
+        {
+            edc ^= data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24;
+            edc = tables.crc[7][edc & 0xFF] ^ tables.crc[6][(edc >> 8) & 0xFF] ^
+                  tables.crc[5][(edc >> 16) & 0xFF] ^ tables.crc[4][edc >> 24] ^
+                  tables.crc[3][data[4]] ^ tables.crc[2][data[5]] ^
+                  tables.crc[1][data[6]] ^ tables.crc[0][data[7]];
+        }
+        for (; size > 0; --size)
+            edc = (edc >> 8) ^ tables.crc[0][(edc ^ *data++) & 0xFF];
+        return edc;
+    }
+
+private:
+    static constexpr int FORM1_EDC_OFFSET = 0x808; // From the subheader
+    static constexpr int FORM2_EDC_OFFSET = 0x91C; // From the subheader
+    static constexpr int ECC_HEADER_SIZE  = 4;
+    static constexpr int ECC_P_OFFSET     = 0x810; // From the header
+    static constexpr int ECC_Q_OFFSET     = 0x8BC; // From the header
+    static constexpr int ECC_P_SIZE       = 172;
+
+    struct Tables
+    {
+        uint32_t crc[8][256] {};
+        uint8_t eccF[256] {};
+        uint8_t eccB[256] {};
+
+        constexpr Tables()
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t edc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    edc = (edc >> 1) ^ ((edc & 1) != 0 ? 0xD8018001 : 0);
+                crc[0][i] = edc;
+
+                // GF(2^8) with the 0x11D polynomial: eccF multiplies by alpha, eccB divides by (alpha + 1).
+                const uint32_t j = (i << 1) ^ ((i & 0x80) != 0 ? 0x11D : 0);
+                eccF[i] = static_cast<uint8_t>(j);
+                eccB[i ^ j] = static_cast<uint8_t>(i);
+            }
+            for (int k = 1; k < 8; ++k)
+            {
+                for (int i = 0; i < 256; ++i)
+                    crc[k][i] = (crc[k - 1][i] >> 8) ^ crc[0][crc[k - 1][i] & 0xFF];
+            }
+        }
+    };
+    static const Tables tables;
+
+    // Reed-Solomon parity of majorCount interleaved codewords of minorCount bytes each (P: 86x24, Q: 52x43).
+    static void computeBlock(const uint8_t *src, const int majorCount, const int minorCount, const int majorMult, const int minorInc, uint8_t *dest)
+    {
+        const int size = majorCount * minorCount;
+        for (int major = 0; major < majorCount; ++major)
+        {
+            int index = (major >> 1) * majorMult + (major & 1);
+            uint8_t eccA = 0;
+            uint8_t eccB = 0;
+            for (int minor = 0; minor < minorCount; ++minor)
+            {
+                const uint8_t temp = src[index];
+                index += minorInc;
+                if (index >= size)
+                    index -= size;
+                eccA = tables.eccF[eccA ^ temp];
+                eccB ^= temp;
+            }
+            eccA = tables.eccB[tables.eccF[eccA] ^ eccB];
+            dest[major] = eccA;
+            dest[major + majorCount] = eccA ^ eccB;
+        }
+    }
+
+    static void putLE32(uint8_t *dest, const uint32_t value)
+    {
+        dest[0] = static_cast<uint8_t>(value);
+        dest[1] = static_cast<uint8_t>(value >> 8);
+        dest[2] = static_cast<uint8_t>(value >> 16);
+        dest[3] = static_cast<uint8_t>(value >> 24);
+    }
+};
+
+// Constant-initialized from the constexpr constructor, defined out of line so Tables is complete.
+inline const edc::Tables edc::tables{};
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "libxa_edc.hxx"
+
 #ifdef _MSC_VER
 #undef fseeko
 #undef strtok_r
@@ -30,6 +32,7 @@ public:
         int nullTrailing;
         std::optional<uint8_t> filenum;
         std::optional<uint8_t> channel;
+        bool autoChannel = false; // "a", the channel is the slot the file was given
         alignas(int) uint8_t nullSubheader[4];
         int begSec;
         int endSec;
@@ -137,7 +140,8 @@ public:
                         entry.filenum = atoi(field);
                         if ((field = strtok_r(NULL, ",", &saveptr)))
                         {
-                            entry.channel = std::tolower(static_cast<uint8_t>(*field)) == 'a' ? idle : atoi(field);
+                            entry.autoChannel = std::tolower(static_cast<uint8_t>(*field)) == 'a';
+                            entry.channel = entry.autoChannel ? idle : atoi(field);
                             while ((field = strtok_r(NULL, ",", &saveptr)))
                             {
                                 if (strncasecmp(field, "0x", 2) != 0)
@@ -168,29 +172,58 @@ public:
 
     // outputFile must be opened in read and write binary (+b) mode.
     // sectorSize must be 2336 or 2352 to change the output size.
-    void interleave(FILE *outputFile, int sectorSize = 0)
+    // regenerateEdc recomputes the EDC/ECC of every output sector, since the filenum and channel rewrite leaves them stale.
+    void interleave(FILE *outputFile, int sectorSize = 0, const bool regenerateEdc = false)
     {
-        uint8_t buffer[CD_SECTOR_SIZE] {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x02};
-        uint8_t emptyBuffer[CD_SECTOR_SIZE] {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x02};
+        uint8_t header[FILENUM_OFFSET] {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x02};
+        uint8_t lastFilenum = 0x00;
+        if (sectorSize != 0 && sectorSize != XA_DATA_SIZE && sectorSize != CD_SECTOR_SIZE)
+        {
+            fprintf(stderr, "Error: Invalid output sector size %d. It must be 2336 or 2352\n", sectorSize);
+            return;
+        }
+
+        // Input sectors are prefetched in batches that share a fixed budget, whatever the stride is.
+        const int prefetchSectors = std::max(PREFETCH_SIZE / (sectorStride * CD_SECTOR_SIZE), 1);
 
         struct SlotInfo
         {
             FileInfo entry;
             FILE *inputFile;
             int sectorCount;
-            std::unique_ptr<char[]> stdiBuf = std::unique_ptr<char[]>(new char[STDIO_IOFBF_SIZE]);
+            std::unique_ptr<uint8_t[]> readBuf;
+            int readPos;
+            int readEnd;
+            std::unique_ptr<uint8_t[]> nullSector;
+            bool nullBuilt;
         };
         std::vector<SlotInfo> slots(sectorStride);
 
         int activeFiles = 0;
-        auto loadFile = [&activeFiles, &slots](const int index, const FileInfo &entry) -> void
+        auto loadFile = [&activeFiles, &slots, prefetchSectors](const int index, const FileInfo &entry) -> void
         {
             activeFiles++;
             auto &slot = slots[index];
             slot.entry = entry;
             slot.entry.nullTrailing = ((entry.sectorCount - 1) % entry.sectorChunk + entry.nullTrailing) / entry.sectorChunk;
             slot.inputFile = fopen(slot.entry.filePath.string().c_str(), "rb");
-            setvbuf(slot.inputFile, slot.stdiBuf.get(), _IOFBF, STDIO_IOFBF_SIZE);
+            setvbuf(slot.inputFile, nullptr, _IONBF, 0);
+            slot.readBuf.reset(new uint8_t[prefetchSectors * entry.sectorSize]);
+            slot.readPos = slot.readEnd = 0;
+            slot.nullBuilt = false;
+        };
+
+        // Returns the next sector of the slot file, or nullptr when there is nothing left to read.
+        auto readSector = [prefetchSectors](SlotInfo &slot) -> uint8_t *
+        {
+            if (slot.readPos == slot.readEnd)
+            {
+                slot.readPos = 0;
+                slot.readEnd = fread(slot.readBuf.get(), slot.entry.sectorSize, prefetchSectors, slot.inputFile);
+                if (slot.readEnd == 0)
+                    return nullptr;
+            }
+            return slot.readBuf.get() + slot.readPos++ * slot.entry.sectorSize;
         };
 
         size_t nextEntryIdx = 0;
@@ -211,40 +244,106 @@ public:
                 slots[i].entry.filenum = entries.back().filenum;
         }
 
+        // Nothing is read when the first stride only has null entries
+        if (activeFiles == 0)
+        {
+            printf("Warning: No entries were interleaved since the first stride has no files.\n");
+            return;
+        }
+
+        // Whole strides are assembled in a reusable block and written out with a single call.
+        const int strideBytes = sectorStride * sectorSize;
+        const int blockBytes  = std::max(OUTPUT_BLOCK_SIZE / strideBytes, 1) * strideBytes;
+        std::unique_ptr<uint8_t[]> block(new uint8_t[blockBytes]);
+        int blockPos = 0;
+
         const int outOffset = CD_SECTOR_SIZE - sectorSize;
         while (activeFiles > 0)
         {
+            // A file loaded in a slot covered by the chunk of another one is read once that slot takes a smaller chunk.
+            // When no file left is read, that never happens, so the idle chunks covering them are split into single slots.
+            // The idle slots they covered may keep the chunk of an older file, so they are split too.
+            // Those files are read from another slot than the one they were given, which then sets their automatic channel.
+            bool reading = false;
+            for (int i = 0; i < sectorStride; i += slots[i].entry.sectorChunk)
+                reading |= slots[i].inputFile != nullptr;
+            for (int i = 0; !reading && i < sectorStride; i += slots[i].entry.sectorChunk)
+            {
+                const int chunkEnd = std::min(i + slots[i].entry.sectorChunk, sectorStride);
+                bool covering = false;
+                for (int j = i + 1; j < chunkEnd; ++j)
+                    covering |= slots[j].inputFile != nullptr;
+                for (int j = i; covering && j < chunkEnd; ++j)
+                {
+                    if (slots[j].inputFile == nullptr)
+                        slots[j].entry.sectorChunk = 1;
+                    else if (slots[j].entry.autoChannel && slots[j].sectorCount == 0)
+                        slots[j].entry.channel = j;
+                }
+            }
+
+            if (blockPos + strideBytes > blockBytes)
+            {
+                fwrite(block.get(), 1, blockPos, outputFile);
+                blockPos = 0;
+            }
+
             for (int i = 0; i < sectorStride;)
             {
-                auto &[entry, inputFile, sectorCount, _] = slots[i];
+                auto &current = slots[i];
+                auto &entry = current.entry;
 
-                for (int j = 0; j < entry.sectorChunk; ++j, ++i)
+                for (int j = 0; j < entry.sectorChunk; ++j, ++i, blockPos += sectorSize)
                 {
-                    if (inputFile != nullptr &&
-                        fread(buffer + (CD_SECTOR_SIZE - entry.sectorSize), 1, entry.sectorSize, inputFile) == entry.sectorSize)
+                    uint8_t *outSector = block.get() + blockPos;
+                    const uint8_t *inSector;
+                    if (current.inputFile != nullptr &&
+                        (inSector = readSector(current)) != nullptr)
                     {
-                        sectorCount++;
-                        buffer[FILENUM_OFFSET + 4] = buffer[FILENUM_OFFSET] = entry.filenum.value_or(buffer[FILENUM_OFFSET]);
-                        buffer[CHANNEL_OFFSET + 4] = buffer[CHANNEL_OFFSET] = entry.channel.value_or(buffer[CHANNEL_OFFSET]);
-                        fwrite(buffer + outOffset, 1, sectorSize, outputFile);
+                        current.sectorCount++;
+                        const int inOffset = CD_SECTOR_SIZE - entry.sectorSize;
+                        if (inOffset == 0)
+                            memcpy(header, inSector, sizeof(header));
+                        if (outOffset == 0)
+                            memcpy(outSector, header, sizeof(header));
+
+                        uint8_t *subheader = outSector + FILENUM_OFFSET - outOffset;
+                        memcpy(subheader, inSector + FILENUM_OFFSET - inOffset, XA_DATA_SIZE);
+                        lastFilenum = subheader[4] = subheader[0] = entry.filenum.value_or(subheader[0]);
+                        subheader[5] = subheader[1] = entry.channel.value_or(subheader[1]);
+                        if (regenerateEdc)
+                            edc::regenerate(subheader);
                     }
                     else
                     {
-                        emptyBuffer[FILENUM_OFFSET] = buffer[FILENUM_OFFSET];
-                        nullCustomizer(emptyBuffer, entry);
-                        memcpy(&emptyBuffer[FILENUM_OFFSET], &entry.nullSubheader, sizeof(entry.nullSubheader));
-                        memcpy(&emptyBuffer[FILENUM_OFFSET + 4], &entry.nullSubheader, sizeof(entry.nullSubheader));
-                        fwrite(emptyBuffer + outOffset, 1, sectorSize, outputFile);
+                        // The null sector of a slot is built once per entry. While the subheader stays zero
+                        // the customizer runs again, as it can still take the filenum of a later sector.
+                        const bool unsettled = *reinterpret_cast<int *>(entry.nullSubheader) == 0;
+                        if (!current.nullBuilt || unsettled)
+                        {
+                            if (!current.nullSector)
+                                current.nullSector.reset(new uint8_t[CD_SECTOR_SIZE] {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x02});
+                            uint8_t *emptyBuffer = current.nullSector.get();
+                            emptyBuffer[FILENUM_OFFSET] = lastFilenum;
+                            nullCustomizer(emptyBuffer, entry);
+                            memcpy(&emptyBuffer[FILENUM_OFFSET], &entry.nullSubheader, sizeof(entry.nullSubheader));
+                            memcpy(&emptyBuffer[FILENUM_OFFSET + 4], &entry.nullSubheader, sizeof(entry.nullSubheader));
+                            if (regenerateEdc && (!current.nullBuilt || *reinterpret_cast<int *>(entry.nullSubheader) != 0))
+                                edc::regenerate(&emptyBuffer[FILENUM_OFFSET]);
+                            current.nullBuilt = true;
+                        }
+                        memcpy(outSector, current.nullSector.get() + outOffset, sectorSize);
                     }
                 }
 
-                if (inputFile != nullptr &&
-                    sectorCount >= entry.sectorCount &&
+                if (current.inputFile != nullptr &&
+                    current.sectorCount >= entry.sectorCount &&
                     entry.nullTrailing-- <= 0)
                 {
                     activeFiles--;
-                    sectorCount = 0;
-                    fclose(std::exchange(inputFile, nullptr));
+                    current.sectorCount = 0;
+                    fclose(std::exchange(current.inputFile, nullptr));
+                    current.readBuf.reset();
                     printf("Interleaving %s... Done\n", entry.filePath.filename().string().c_str());
 
                     for (int idle = 0, index = 0, target; index < sectorStride && nextEntryIdx < entries.size(); ++index)
@@ -268,12 +367,16 @@ public:
                             if (nextEntry.sectorSize > 0)
                                 loadFile(target, nextEntry);
                             else
+                            {
                                 slot.entry = nextEntry;
+                                slot.nullBuilt = false;
+                            }
                         }
                     }
                 }
             }
         }
+        fwrite(block.get(), 1, blockPos, outputFile);
 
         if (nextEntryIdx < entries.size())
         {
@@ -281,12 +384,16 @@ public:
                    "         This can happen when mixing large chunks with null entries.\n", entries.size() - nextEntryIdx);
         }
 
-        fseeko(outputFile, -2334, SEEK_END);
-        int EOFbit = fgetc(outputFile) | 0x80;
-        fseeko(outputFile, -2334, SEEK_END);
-        fputc(EOFbit, outputFile);
-        fseeko(outputFile, -2330, SEEK_END);
-        fputc(EOFbit, outputFile);
+        // The EOF bit goes on the last sector, which then needs its EDC/ECC again.
+        uint8_t lastSector[XA_DATA_SIZE];
+        fseeko(outputFile, -XA_DATA_SIZE, SEEK_END);
+        if (fread(lastSector, 1, XA_DATA_SIZE, outputFile) != XA_DATA_SIZE)
+            return;
+        lastSector[6] = lastSector[2] |= 0x80;
+        if (regenerateEdc)
+            edc::regenerate(lastSector);
+        fseeko(outputFile, -XA_DATA_SIZE, SEEK_END);
+        fwrite(lastSector, 1, XA_DATA_SIZE, outputFile);
         fseeko(outputFile, 0, SEEK_END);
     }
 
@@ -298,9 +405,10 @@ protected:
 
 private:
     const int sectorStride;
-    static constexpr int STDIO_IOFBF_SIZE = 1024 * 1024; // 1MiB
+    static constexpr int PREFETCH_SIZE     = 1024 * 1024; // 1MiB shared by all the slots
+    static constexpr int OUTPUT_BLOCK_SIZE = 1024 * 1024; // 1MiB
 
-    // Virtual function to fill null sectors as needed.
+    // Virtual function to fill null sectors as needed. Called once for each entry that needs null sectors.
     virtual void nullCustomizer(uint8_t *emptyBuffer, FileInfo &entry)
     {
         if (*reinterpret_cast<int *>(entry.nullSubheader) != 0)
@@ -0,0 +1,189 @@
+#pragma once
+
+#ifdef _MSC_VER
+#undef fseeko
+#define fseeko _fseeki64
+#endif
+
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+// Lists the .XA/.STR files of the ISO9660 filesystem of a raw 2352 bytes CD image (.bin/.img, or the track of a .cue).
+class iso9660
+{
+public:
+    struct Extent
+    {
+        std::string filePath; // UTF-8, from the root directory and without the ";1" version
+        int begSec;
+        int sectorCount;
+    };
+    std::vector<Extent> extents;
+    std::filesystem::path imagePath; // Empty if the input is not a CD image with an ISO9660 filesystem
+
+    explicit iso9660(const std::filesystem::path &inputPath)
+    {
+        std::string ext = inputPath.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (ext != ".bin" && ext != ".img" && ext != ".cue")
+            return;
+
+        std::filesystem::path binPath = inputPath;
+        if (ext == ".cue" && (binPath = cueTrack(inputPath)).empty())
+            return;
+
+        std::unique_ptr<FILE, decltype(&fclose)> imageFile(fopen(binPath.string().c_str(), "rb"), &fclose);
+        if (!imageFile)
+        {
+            fprintf(stderr, "Error: Cannot read \"%s\". %s\n", binPath.filename().string().c_str(), strerror(errno));
+            return;
+        }
+
+        std::error_code ec;
+        const uintmax_t fileSize = std::filesystem::file_size(binPath, ec);
+        if (ec || fileSize % CD_SECTOR_SIZE != 0)
+            return;
+        totalSectors = fileSize / CD_SECTOR_SIZE;
+
+        // Primary volume descriptor
+        uint8_t pvd[BLOCK_SIZE];
+        if (!readBlocks(imageFile.get(), PVD_SECTOR, 1, pvd) ||
+            pvd[0] != 0x01 || memcmp(pvd + 1, "CD001", 5) != 0 || getLE16(pvd + 128) != BLOCK_SIZE)
+            return;
+
+        // The path table lists every directory, parents first
+        struct Directory
+        {
+            std::string path;
+            uint32_t lba;
+        };
+        std::vector<Directory> directories;
+        const uint32_t pathTableSize = getLE32(pvd + 132);
+        std::vector<uint8_t> pathTable;
+        if (!readExtent(imageFile.get(), getLE32(pvd + 140), pathTableSize, pathTable))
+            return;
+        for (size_t pos = 0; pos + 8 <= pathTableSize;)
+        {
+            const uint8_t nameLength = pathTable[pos];
+            const uint16_t parent = getLE16(&pathTable[pos + 6]);
+            if (nameLength == 0 || pos + 8 + nameLength > pathTableSize)
+                break;
+
+            Directory directory{"", getLE32(&pathTable[pos + 2])};
+            if (!directories.empty() && parent >= 1 && parent <= directories.size())
+                directory.path = directories[parent - 1].path + std::string(reinterpret_cast<const char *>(&pathTable[pos + 8]), nameLength) + "/";
+            directories.push_back(std::move(directory));
+            pos += 8 + nameLength + (nameLength & 1);
+        }
+
+        for (const Directory &directory : directories)
+        {
+            // The size of a directory is in its own "." record
+            uint8_t first[BLOCK_SIZE];
+            std::vector<uint8_t> records;
+            if (!readBlocks(imageFile.get(), directory.lba, 1, first) || first[0] < 34 ||
+                !readExtent(imageFile.get(), directory.lba, getLE32(first + 10), records))
+                continue;
+
+            for (size_t pos = 0; pos < records.size();)
+            {
+                const uint8_t recordLength = records[pos];
+                if (recordLength == 0) // Records do not cross blocks
+                {
+                    pos = (pos / BLOCK_SIZE + 1) * BLOCK_SIZE;
+                    continue;
+                }
+                if (recordLength < 34 || pos + recordLength > records.size())
+                    break;
+
+                const uint8_t *record = &records[pos];
+                pos += recordLength;
+                if ((record[25] & 0x02) != 0) // Directory flag
+                    continue;
+
+                std::string name(reinterpret_cast<const char *>(record + 33), std::min<int>(record[32], recordLength - 33));
+                name.erase(std::min(name.find(';'), name.size()));
+                std::string nameExt = std::filesystem::u8path(name).extension().u8string();
+                std::transform(nameExt.begin(), nameExt.end(), nameExt.begin(), [](unsigned char c) { return std::tolower(c); });
+                if (nameExt != ".xa" && nameExt != ".str")
+                    continue;
+
+                const uint32_t lba = getLE32(record + 2);
+                const uint32_t sectorCount = (getLE32(record + 10) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+                if (sectorCount == 0 || lba >= totalSectors)
+                    continue;
+                extents.push_back({directory.path + name, static_cast<int>(lba), static_cast<int>(std::min<uintmax_t>(sectorCount, totalSectors - lba))});
+            }
+        }
+
+        // Hard links share the extent
+        std::stable_sort(extents.begin(), extents.end(), [](const Extent &a, const Extent &b) { return a.begSec < b.begSec; });
+        extents.erase(std::unique(extents.begin(), extents.end(), [](const Extent &a, const Extent &b) { return a.begSec == b.begSec; }), extents.end());
+        imagePath = std::move(binPath);
+    }
+
+private:
+    static constexpr int CD_SECTOR_SIZE = 2352;
+    static constexpr int BLOCK_SIZE     = 2048;
+    static constexpr int PVD_SECTOR     = 16;
+    uintmax_t totalSectors = 0;
+
+    static uint16_t getLE16(const uint8_t *src) { return src[0] | src[1] << 8; }
+    static uint32_t getLE32(const uint8_t *src) { return src[0] | src[1] << 8 | src[2] << 16 | static_cast<uint32_t>(src[3]) << 24; }
+
+    // Path of the first FILE of a .cue sheet, relative to the sheet.
+    static std::filesystem::path cueTrack(const std::filesystem::path &cuePath)
+    {
+        std::unique_ptr<FILE, decltype(&fclose)> cueFile(fopen(cuePath.string().c_str(), "r"), &fclose);
+        if (!cueFile)
+        {
+            fprintf(stderr, "Error: Cannot read \"%s\". %s\n", cuePath.filename().string().c_str(), strerror(errno));
+            return {};
+        }
+
+        char line[1024];
+        while (fgets(line, sizeof(line), cueFile.get()))
+        {
+            const char *field = line + strspn(line, " \t");
+            if (strncmp(field, "FILE ", 5) != 0)
+                continue;
+
+            field += 5;
+            const char *end;
+            if (*field == '"' && (end = strchr(++field, '"')))
+                return cuePath.parent_path() / std::filesystem::u8path(std::string(field, end));
+            return cuePath.parent_path() / std::filesystem::u8path(std::string(field, strcspn(field, " \t\r\n")));
+        }
+        fprintf(stderr, "Error: There is no FILE in \"%s\".\n", cuePath.filename().string().c_str());
+        return {};
+    }
+
+    // Reads the 2048 bytes user data of count Mode 1 or Mode 2 Form 1 sectors.
+    bool readBlocks(FILE *imageFile, const uint32_t lba, const uint32_t count, uint8_t *dest) const
+    {
+        if (lba + static_cast<uintmax_t>(count) > totalSectors)
+            return false;
+
+        uint8_t sector[CD_SECTOR_SIZE];
+        fseeko(imageFile, static_cast<int64_t>(lba) * CD_SECTOR_SIZE, SEEK_SET);
+        for (uint32_t i = 0; i < count; ++i, dest += BLOCK_SIZE)
+        {
+            if (fread(sector, 1, CD_SECTOR_SIZE, imageFile) != CD_SECTOR_SIZE)
+                return false;
+            memcpy(dest, sector + (sector[15] == 2 ? 24 : 16), BLOCK_SIZE); // Mode byte of the header
+        }
+        return true;
+    }
+
+    bool readExtent(FILE *imageFile, const uint32_t lba, const uint32_t size, std::vector<uint8_t> &dest) const
+    {
+        const uint32_t count = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (count == 0 || lba + static_cast<uintmax_t>(count) > totalSectors)
+            return false;
+        dest.resize(static_cast<size_t>(count) * BLOCK_SIZE);
+        return readBlocks(imageFile, lba, count, dest.data());
+    }
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "libxa_deinterleaver.hxx"
+#include "libxa_edc.hxx"
+
+// Writes deinterleaved files over the streams of an interleaved file, in place.
+class replacer
+{
+public:
+    struct Replacement
+    {
+        std::filesystem::path srcPath;
+        const deinterleaver::FileInfo *entry;
+        deinterleaver *target; // Analysis the stream belongs to
+        int srcSectorSize;
+        int srcSectorCount;
+        int fillCount;
+        uint8_t eofBit;
+    };
+
+    // Sector of the target stream where the index-th source (or filler) sector goes.
+    static intmax_t streamSector(const deinterleaver::FileInfo &entry, const int index)
+    {
+        return entry.begSec + static_cast<intmax_t>(index / entry.sectorChunk) * (entry.sectorChunk + entry.sectorStride) + index % entry.sectorChunk;
+    }
+
+    // Writes every replacement in a single ordered sweep over the target.
+    // Blocks of target sectors are read once, patched in memory and written back with a single call.
+    static void apply(FILE *tgtFile, const int tgtSectorSize, const intmax_t tgtSectorCount, const std::vector<Replacement> &replacements)
+    {
+        struct Write
+        {
+            intmax_t sector;
+            size_t replacement;
+            int index;
+        };
+        std::vector<Write> writes;
+        for (size_t r = 0; r < replacements.size(); ++r)
+        {
+            const Replacement &replacement = replacements[r];
+            for (int i = 0; i < replacement.srcSectorCount + replacement.fillCount; ++i)
+                writes.push_back({streamSector(*replacement.entry, i), r, i});
+        }
+        std::stable_sort(writes.begin(), writes.end(), [](const Write &a, const Write &b) { return a.sector < b.sector; });
+
+        // Sectors beyond the end of the target cannot be written
+        writes.erase(std::find_if(writes.begin(), writes.end(), [tgtSectorCount](const Write &write) { return write.sector >= tgtSectorCount; }), writes.end());
+
+        uint8_t buffer[CD_SECTOR_SIZE] {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+        std::vector<std::unique_ptr<FILE, decltype(&fclose)>> srcFiles;
+        for (size_t r = 0; r < replacements.size(); ++r)
+            srcFiles.emplace_back(nullptr, &fclose);
+
+        const int dataOffset = tgtSectorSize - XA_DATA_SIZE;
+        std::unique_ptr<uint8_t[]> block(new uint8_t[SWEEP_BLOCK_SECTORS * tgtSectorSize]);
+        for (size_t w = 0; w < writes.size();)
+        {
+            const intmax_t firstSec = writes[w].sector;
+            const size_t span = std::min<intmax_t>(SWEEP_BLOCK_SECTORS, tgtSectorCount - firstSec);
+            fseeko(tgtFile, static_cast<int64_t>(firstSec) * tgtSectorSize, SEEK_SET);
+            const size_t readSectors = fread(block.get(), tgtSectorSize, span, tgtFile);
+            if (readSectors == 0)
+                break;
+
+            intmax_t lastSec = firstSec;
+            for (; w < writes.size() && writes[w].sector < firstSec + static_cast<intmax_t>(readSectors); ++w)
+            {
+                const Write &write = writes[w];
+                const Replacement &replacement = replacements[write.replacement];
+                const deinterleaver::FileInfo &entry = *replacement.entry;
+                uint8_t *data = block.get() + (write.sector - firstSec) * tgtSectorSize + dataOffset;
+
+                if (write.index < replacement.srcSectorCount)
+                {
+                    auto &srcFile = srcFiles[write.replacement];
+                    if (!srcFile)
+                        srcFile.reset(fopen(replacement.srcPath.string().c_str(), "rb"));
+
+                    [[maybe_unused]] size_t __ = fread(buffer + CD_SECTOR_SIZE - replacement.srcSectorSize, 1, replacement.srcSectorSize, srcFile.get());
+                    memcpy(data, buffer + SUBHEAD_OFFSET, XA_DATA_SIZE);
+                    data[4] = data[0] = entry.filenum;
+                    data[5] = data[1] = entry.channel;
+                    if (write.index == replacement.srcSectorCount - 1)
+                    {
+                        data[6] = data[2] = (data[2] & 0x7F) | replacement.eofBit;
+                        srcFile.reset();
+                    }
+                }
+                else
+                {
+                    // Null filler
+                    memcpy(data, &entry.nullSubheader, sizeof(entry.nullSubheader));
+                    memcpy(data + 4, &entry.nullSubheader, sizeof(entry.nullSubheader));
+                    memset(data + 8, entry.nullSubheader[2] == 0xFF ? 0xFF : 0, XA_DATA_SIZE - 8);
+                }
+                // The new subheader invalidates the EDC/ECC copied from the source. 0xFF filled sectors stay as they are.
+                if (data[2] != 0xFF)
+                    edc::regenerate(data);
+                replacement.target->refreshSector(write.sector, data);
+                lastSec = write.sector;
+            }
+
+            fseeko(tgtFile, static_cast<int64_t>(firstSec) * tgtSectorSize, SEEK_SET);
+            fwrite(block.get(), tgtSectorSize, lastSec - firstSec + 1, tgtFile);
+        }
+    }
+
+private:
+    static constexpr int CD_SECTOR_SIZE      = 2352;
+    static constexpr int XA_DATA_SIZE        = 2336;
+    static constexpr int SUBHEAD_OFFSET      = 0x10;
+    static constexpr int SWEEP_BLOCK_SECTORS = 448; // ~1MiB of 2336/2352 sectors
+};
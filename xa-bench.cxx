@@ -0,0 +1,642 @@
+#include "libxa_classifier.hxx"
+#include "libxa_edc.hxx"
+#include "libxa_interleaver.hxx"
+#include "libxa_replacer.hxx"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <io.h>
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#define dup _dup
+#define dup2 _dup2
+#define open _open
+#define close _close
+#define fileno _fileno
+#define NULL_DEVICE "NUL"
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define VER "VERSION"
+#define XA_DATA_SIZE 2336
+
+// Reference null/silent check, the memcmp loop the deinterleaver used before the classifier kernel.
+static bool legacyIsNull(const uint8_t *subheader, const int bytes = 16)
+{
+    static constexpr uint8_t emptyBuffer[112]{};
+
+    if (subheader[2] == 0xFF)
+        return true;
+
+    int groups = ((subheader[2] & 0x20) != 0 ? 18 : 16) * 128 - 0x10;
+    for (int i = bytes != 16 ? 0x18 : 0x08; i < groups; i += 128)
+    {
+        if (memcmp(subheader + i, emptyBuffer, bytes) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Fills sectorCount 2336 bytes sectors with a deterministic mix of audio, null, silent and data sectors.
+static std::unique_ptr<uint8_t[]> makeSectors(const size_t sectorCount, const uint32_t seed)
+{
+    std::unique_ptr<uint8_t[]> sectors(new uint8_t[sectorCount * XA_DATA_SIZE]);
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < sectorCount; ++i)
+    {
+        uint8_t *sector = sectors.get() + i * XA_DATA_SIZE;
+        for (int j = 0; j < XA_DATA_SIZE; ++j)
+            sector[j] = static_cast<uint8_t>(rng());
+
+        const uint32_t kind = rng() % 20;
+        sector[2] = sector[6] = kind < 18 ? 0x64 : (kind == 18 ? 0xFF : 0x08); // Audio+Form2+RT, 0xFF null or data
+        for (int g = 0; g < 18; ++g)
+        {
+            uint8_t *group = sector + 0x08 + g * 128;
+            if (kind >= 14 && kind < 16) // Null audio: zero sound groups
+                memset(group, 0, g < 17 ? 128 : XA_DATA_SIZE - (0x08 + g * 128));
+            else if (kind >= 16 && kind < 18) // Silent audio: zero sample data
+                memset(group + 16, 0, g < 17 ? 112 : XA_DATA_SIZE - (0x08 + g * 128 + 16));
+        }
+    }
+    return sectors;
+}
+
+static int benchClassify(const size_t sectorCount, const int iterations)
+{
+    std::unique_ptr<uint8_t[]> sectors = makeSectors(sectorCount, 1);
+    std::vector<uint8_t> legacyFlags(sectorCount);
+    std::vector<uint8_t> kernelFlags(sectorCount);
+    constexpr uint8_t mask = classifier::NULL_FLAG | classifier::SILENT_FLAG;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+    {
+        for (size_t i = 0; i < sectorCount; ++i)
+        {
+            const uint8_t *subheader = sectors.get() + i * XA_DATA_SIZE;
+            legacyFlags[i] = (legacyIsNull(subheader) ? classifier::NULL_FLAG : 0) | (legacyIsNull(subheader, 112) ? classifier::SILENT_FLAG : 0);
+        }
+    }
+    const double legacyTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+        classifier::classify(sectors.get(), sectorCount, XA_DATA_SIZE, kernelFlags.data());
+    const double kernelTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (size_t i = 0; i < sectorCount; ++i)
+    {
+        if (legacyFlags[i] != (kernelFlags[i] & mask))
+        {
+            fprintf(stderr, "Error: Classifier mismatch at sector %zu (memcmp 0x%02X, %s 0x%02X).\n", i, legacyFlags[i], classifier::isa, kernelFlags[i] & mask);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const double total = static_cast<double>(sectorCount) * iterations;
+    printf("Classify %zu sectors x %d\n", sectorCount, iterations);
+    printf("  memcmp: %8.2f ns/sector %10.0f sectors/s\n", legacyTime * 1e9 / total, total / legacyTime);
+    printf("  %-6s: %8.2f ns/sector %10.0f sectors/s\n", classifier::isa, kernelTime * 1e9 / total, total / kernelTime);
+    printf(" Speedup: %.2fx\n", legacyTime / kernelTime);
+    return EXIT_SUCCESS;
+}
+
+// Bit at a time EDC, the reference for the table driven one.
+static uint32_t legacyEdc(const uint8_t *data, size_t size)
+{
+    uint32_t edc = 0;
+    while (size-- > 0)
+    {
+        edc ^= *data++;
+        for (int bit = 0; bit < 8; ++bit)
+            edc = (edc >> 1) ^ ((edc & 1) != 0 ? 0xD8018001 : 0);
+    }
+    return edc;
+}
+
+static int benchEdc(const size_t sectorCount, const int iterations)
+{
+    std::unique_ptr<uint8_t[]> sectors = makeSectors(sectorCount, 2);
+    for (size_t i = 0; i < sectorCount; i += 2)
+        sectors[i * XA_DATA_SIZE + 2] = sectors[i * XA_DATA_SIZE + 6] = 0x08; // Every other sector is Form 1, with ECC
+
+    for (size_t i = 0; i < sectorCount; ++i)
+    {
+        uint8_t *subheader = sectors.get() + i * XA_DATA_SIZE;
+        const size_t edcOffset = (subheader[2] & 0x20) != 0 ? 0x91C : 0x808;
+        const uint32_t expected = legacyEdc(subheader, edcOffset);
+        edc::regenerate(subheader);
+        const uint32_t stored = subheader[edcOffset] | subheader[edcOffset + 1] << 8 | subheader[edcOffset + 2] << 16 | static_cast<uint32_t>(subheader[edcOffset + 3]) << 24;
+        if (stored != expected)
+        {
+            fprintf(stderr, "Error: EDC mismatch at sector %zu (0x%08X, expected 0x%08X).\n", i, stored, expected);
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    volatile uint32_t sink = 0; // Keeps the CRC loops from being optimized out
+    for (int it = 0; it < iterations; ++it)
+    {
+        for (size_t i = 0; i < sectorCount; ++i)
+            sink = sink ^ legacyEdc(sectors.get() + i * XA_DATA_SIZE, 0x91C);
+    }
+    const double legacyTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+    {
+        for (size_t i = 0; i < sectorCount; ++i)
+            sink = sink ^ edc::crc(sectors.get() + i * XA_DATA_SIZE, 0x91C);
+    }
+    const double crcTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; ++it)
+    {
+        for (size_t i = 0; i < sectorCount; ++i)
+            edc::regenerate(sectors.get() + i * XA_DATA_SIZE);
+    }
+    const double regenTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const double total = static_cast<double>(sectorCount) * iterations;
+    const double bytes = total * XA_DATA_SIZE / (1024 * 1024);
+    printf("EDC/ECC %zu sectors x %d (half Form 1)\n", sectorCount, iterations);
+    printf("  bitwise CRC: %8.2f ns/sector %8.1f MiB/s\n", legacyTime * 1e9 / total, bytes / legacyTime);
+    printf("    table CRC: %8.2f ns/sector %8.1f MiB/s\n", crcTime * 1e9 / total, bytes / crcTime);
+    printf("   regenerate: %8.2f ns/sector %8.1f MiB/s\n", regenTime * 1e9 / total, bytes / regenTime);
+    return EXIT_SUCCESS;
+}
+
+// Peak resident set size of the process so far, in bytes.
+static size_t peakRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Sends stdout to the null device while a stage runs, so the progress output of the library is not timed.
+class QuietStdout
+{
+public:
+    QuietStdout()
+    {
+        fflush(stdout);
+        savedFd = dup(fileno(stdout));
+        const int nullFd = open(NULL_DEVICE, O_WRONLY);
+        if (nullFd >= 0)
+        {
+            dup2(nullFd, fileno(stdout));
+            close(nullFd);
+        }
+    }
+    ~QuietStdout()
+    {
+        fflush(stdout);
+        if (savedFd >= 0)
+        {
+            dup2(savedFd, fileno(stdout));
+            close(savedFd);
+        }
+    }
+
+private:
+    int savedFd;
+};
+
+struct ArchiveSpec
+{
+    int streams;
+    int stride;
+    int sectorSize; // 2336 or 2352
+    int chunk;      // 1, or the chunk of every other stream (e.g. 7 for video)
+    int nulls;      // Longest null trailing run, 0 for none
+    int silent;     // Number of silence-only streams
+    uint32_t seed;
+    bool edc;       // Regenerate EDC/ECC when interleaving
+};
+
+// A line of the generated manifest
+struct Source
+{
+    std::string fileName;
+    int chunk;
+    int nullTrailing;
+    bool silent;
+};
+
+// Writes the sources and the manifest of a deterministic synthetic archive. Returns the number of silent streams.
+static int makeArchive(const std::filesystem::path &dir, const ArchiveSpec &spec, std::vector<Source> &sources)
+{
+    std::filesystem::create_directories(dir);
+    std::unique_ptr<FILE, decltype(&fclose)> manifest(fopen((dir / "archive.csv").string().c_str(), "w"), &fclose);
+    if (!manifest)
+        return -1;
+
+    std::mt19937 rng(spec.seed);
+    const int offset = spec.sectorSize - XA_DATA_SIZE;
+    const int videoChunk = std::max(std::min(spec.chunk, spec.stride - 1), 1);
+    uint8_t sector[2352] {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x02};
+    int silentStreams = 0;
+    for (int i = 0; i < spec.streams; ++i)
+    {
+        const int chunk = i % 2 == 0 ? videoChunk : 1;
+        const int sectorCount = 50 + rng() % 500;
+        const int nullTrailing = spec.nulls > 0 && i % 3 == 0 ? 1 + rng() % spec.nulls : 0;
+        const bool silent = spec.silent > 0 && (i * spec.silent) % spec.streams < spec.silent; // Spread over the archive
+        silentStreams += silent;
+
+        char fileName[16];
+        snprintf(fileName, sizeof(fileName), "s%02d.xa", i);
+        std::unique_ptr<FILE, decltype(&fclose)> source(fopen((dir / fileName).string().c_str(), "wb"), &fclose);
+        if (!source)
+            return -1;
+        for (int s = 0; s < sectorCount; ++s)
+        {
+            uint8_t *subheader = sector + 0x10;
+            subheader[4] = subheader[0] = 1;
+            subheader[5] = subheader[1] = i % 32;
+            subheader[6] = subheader[2] = s == sectorCount - 1 ? 0xE4 : 0x64; // Audio+Form2+RT, EOF on the last one
+            subheader[7] = subheader[3] = 0x01;
+            for (int j = 8; j < XA_DATA_SIZE; ++j)
+            {
+                const bool head = (j - 8) % 128 < 16;
+                subheader[j] = silent && !head ? 0 : static_cast<uint8_t>(rng() | (head ? 1 : 0));
+            }
+            fwrite(sector + 2352 - spec.sectorSize, 1, spec.sectorSize, source.get());
+        }
+        fprintf(manifest.get(), "%d,%s,%s,%d,1,a\n", chunk, offset != 0 ? "xacd" : "xa", fileName, nullTrailing);
+        sources.push_back({fileName, chunk, nullTrailing, silent});
+    }
+    return silentStreams;
+}
+
+static bool sameFiles(const std::filesystem::path &a, const std::filesystem::path &b)
+{
+    std::unique_ptr<FILE, decltype(&fclose)> fileA(fopen(a.string().c_str(), "rb"), &fclose);
+    std::unique_ptr<FILE, decltype(&fclose)> fileB(fopen(b.string().c_str(), "rb"), &fclose);
+    if (!fileA || !fileB)
+        return false;
+
+    std::vector<uint8_t> bufA(1024 * 1024);
+    std::vector<uint8_t> bufB(1024 * 1024);
+    size_t readA;
+    do {
+        readA = fread(bufA.data(), 1, bufA.size(), fileA.get());
+        if (fread(bufB.data(), 1, bufB.size(), fileB.get()) != readA || memcmp(bufA.data(), bufB.data(), readA) != 0)
+            return false;
+    } while (readA > 0);
+    return true;
+}
+
+// Compares the XA data of every sector from the byte at first up to the EDC/ECC, which the tools may regenerate.
+static bool sameSectors(const std::filesystem::path &a, const std::filesystem::path &b, const int sectorSize, const int first)
+{
+    std::unique_ptr<FILE, decltype(&fclose)> fileA(fopen(a.string().c_str(), "rb"), &fclose);
+    std::unique_ptr<FILE, decltype(&fclose)> fileB(fopen(b.string().c_str(), "rb"), &fclose);
+    if (!fileA || !fileB)
+        return false;
+
+    const int dataOffset = sectorSize - XA_DATA_SIZE;
+    std::vector<uint8_t> bufA(448 * sectorSize);
+    std::vector<uint8_t> bufB(448 * sectorSize);
+    size_t readA;
+    do {
+        readA = fread(bufA.data(), sectorSize, 448, fileA.get());
+        if (fread(bufB.data(), sectorSize, 448, fileB.get()) != readA)
+            return false;
+        for (size_t s = 0; s < readA; ++s)
+        {
+            const uint8_t *dataA = bufA.data() + s * sectorSize + dataOffset;
+            const uint8_t *dataB = bufB.data() + s * sectorSize + dataOffset;
+            const int edcOffset = (dataA[2] & 0x20) != 0 ? 0x91C : 0x808;
+            if (memcmp(dataA + first, dataB + first, edcOffset - first) != 0)
+                return false;
+        }
+    } while (readA > 0);
+    return true;
+}
+
+struct Stage
+{
+    const char *name;
+    double seconds;
+    double bytes;
+    size_t sectors;
+    size_t rss;
+};
+
+static bool interleaveFile(const std::filesystem::path &manifest, const std::filesystem::path &output, const ArchiveSpec &spec)
+{
+    interleaver files(manifest, spec.stride);
+    if (files.entries.empty())
+        return false;
+    std::unique_ptr<char[]> stdoBuf(new char[1024 * 1024]); // Outlives the file, which is flushed on close
+    std::unique_ptr<FILE, decltype(&fclose)> outputFile(fopen(output.string().c_str(), "w+b"), &fclose);
+    if (!outputFile)
+        return false;
+    setvbuf(outputFile.get(), stdoBuf.get(), _IOFBF, 1024 * 1024);
+    files.interleave(outputFile.get(), spec.sectorSize, spec.edc);
+    return true;
+}
+
+// Generates an archive, times every stage of the tools on it and checks the round-trip.
+// Every generated stream must deinterleave back to its own data (silent streams are dropped by design),
+// laid out as the generated manifest the deinterleaved streams must interleave back to the same bytes,
+// and replacing every stream with its own deinterleaved file must leave the archive unchanged.
+static bool roundTrip(const ArchiveSpec &spec, std::vector<Stage> &stages)
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / ("xa-bench-" + std::to_string(spec.seed));
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+
+    std::vector<Source> sources;
+    const int silentStreams = makeArchive(dir / "src", spec, sources);
+    if (silentStreams < 0)
+    {
+        fprintf(stderr, "Error: Cannot write the synthetic archive in \"%s\". %s\n", dir.string().c_str(), strerror(errno));
+        return false;
+    }
+
+    const std::filesystem::path archive = dir / "archive.xa";
+    const std::filesystem::path output = dir / "out";
+    const std::filesystem::path archive2 = dir / "archive2.xa";
+    const std::filesystem::path replaced = dir / "replaced.xa";
+    auto time = [&stages](const char *name, auto &&stage) -> bool
+    {
+        const auto start = std::chrono::steady_clock::now();
+        bool ok;
+        {
+            QuietStdout quiet;
+            ok = stage();
+        }
+        stages.push_back({name, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 0, 0, peakRss()});
+        return ok;
+    };
+
+    bool ok = time("interleave", [&]() { return interleaveFile(dir / "src" / "archive.csv", archive, spec); });
+    const uintmax_t archiveSize = ok ? std::filesystem::file_size(archive) : 0;
+    stages.back().bytes = static_cast<double>(archiveSize);
+
+    std::unique_ptr<deinterleaver> analysis;
+    if (ok)
+    {
+        ok = time("analysis", [&]() { analysis.reset(new deinterleaver(archive, false)); return !analysis->entries.empty(); });
+        stages.back().bytes = static_cast<double>(archiveSize);
+    }
+    if (ok && analysis->entries.size() != static_cast<size_t>(spec.streams - silentStreams))
+    {
+        fprintf(stderr, "Error: Found %zu streams, expected %d.\n", analysis->entries.size(), spec.streams - silentStreams);
+        ok = false;
+    }
+
+    if (ok)
+    {
+        ok = time("deinterleave", [&]() { return analysis->deinterleave(output, 0, 1); });
+        stages.back().bytes = static_cast<double>(archiveSize);
+    }
+
+    // Streams are named by their position in the archive, so they are matched to the sources by content.
+    // The interleaver rewrites the subheader, so it is left out.
+    std::vector<std::string> layout; // File of every line of the generated manifest, relative to dir
+    std::vector<bool> matched(ok ? analysis->entries.size() : 0);
+    for (size_t i = 0; ok && i < sources.size(); ++i)
+    {
+        if (sources[i].silent)
+        {
+            layout.push_back("src/" + sources[i].fileName);
+            continue;
+        }
+        size_t j = 0;
+        while (j < matched.size() && (matched[j] ||
+               !sameSectors(dir / "src" / sources[i].fileName, output / std::filesystem::u8path(analysis->entries[j].fileName), spec.sectorSize, 8)))
+            ++j;
+        if (j == matched.size())
+        {
+            fprintf(stderr, "Error: %s was not deinterleaved back.\n", sources[i].fileName.c_str());
+            ok = false;
+            break;
+        }
+        matched[j] = true;
+        layout.push_back("out/" + analysis->entries[j].fileName);
+    }
+
+    // The manifest of the deinterleaver may order the streams differently, as the idle slots between them read back as null_trailing.
+    // The generated one must give the same archive again.
+    if (ok)
+    {
+        std::unique_ptr<FILE, decltype(&fclose)> manifest(fopen((dir / "layout.csv").string().c_str(), "w"), &fclose);
+        ok = manifest != nullptr;
+        for (size_t i = 0; ok && i < sources.size(); ++i)
+            fprintf(manifest.get(), "%d,%s,%s,%d,1,a\n", sources[i].chunk, spec.sectorSize != XA_DATA_SIZE ? "xacd" : "xa", layout[i].c_str(), sources[i].nullTrailing);
+    }
+    if (ok)
+    {
+        QuietStdout quiet;
+        ok = interleaveFile(dir / "layout.csv", archive2, spec) && sameFiles(archive, archive2);
+        if (!ok)
+            fprintf(stderr, "Error: interleave -> deinterleave -> interleave is not identical.\n");
+    }
+
+    // Identity replace of every stream, through the same single sweep as xa-replacer
+    std::unique_ptr<FILE, decltype(&fclose)> target(nullptr, &fclose);
+    std::unique_ptr<deinterleaver> targetAnalysis;
+    std::vector<replacer::Replacement> replacements;
+    if (ok)
+    {
+        QuietStdout quiet;
+        std::filesystem::copy_file(archive, replaced, std::filesystem::copy_options::overwrite_existing, ec);
+        targetAnalysis.reset(new deinterleaver(replaced, false));
+        target.reset(fopen(replaced.string().c_str(), "r+b"));
+        ok = !ec && target;
+    }
+    double replacedBytes = 0;
+    ok = ok && targetAnalysis->entries.size() == analysis->entries.size();
+    for (size_t i = 0; ok && i < targetAnalysis->entries.size(); ++i)
+    {
+        const deinterleaver::FileInfo &entry = targetAnalysis->entries[i];
+        const std::filesystem::path srcPath = output / std::filesystem::u8path(analysis->entries[i].fileName); // Same streams, named after archive.xa
+        const int srcSectorCount = std::filesystem::file_size(srcPath) / spec.sectorSize;
+        fseeko(target.get(), static_cast<int64_t>(entry.endSec) * spec.sectorSize + spec.sectorSize - XA_DATA_SIZE + 2, SEEK_SET);
+        const uint8_t eofBit = fgetc(target.get()) & 0x80;
+        replacements.push_back({srcPath, &entry, targetAnalysis.get(), spec.sectorSize, srcSectorCount, 0, eofBit});
+        replacedBytes += static_cast<double>(srcSectorCount) * spec.sectorSize;
+    }
+    if (ok)
+    {
+        ok = time("replace", [&]() { replacer::apply(target.get(), spec.sectorSize, archiveSize / spec.sectorSize, replacements); return fflush(target.get()) == 0; });
+        stages.back().bytes = replacedBytes;
+    }
+    target.reset();
+    // The replacer always regenerates the EDC/ECC of the sectors it writes
+    if (ok && !(spec.edc ? sameFiles(archive, replaced) : sameSectors(archive, replaced, spec.sectorSize, 0)))
+    {
+        fprintf(stderr, "Error: Replacing every stream with itself changed the archive.\n");
+        ok = false;
+    }
+
+    for (Stage &stage : stages)
+        stage.sectors = static_cast<size_t>(stage.bytes / spec.sectorSize);
+    analysis.reset();
+    targetAnalysis.reset();
+    std::filesystem::remove_all(dir, ec);
+    return ok;
+}
+
+static int benchRoundTrip(const ArchiveSpec &spec)
+{
+    std::vector<Stage> stages;
+    const bool ok = roundTrip(spec, stages);
+
+    printf("Round-trip %d streams, stride %d, chunk %d, %d bytes sectors, nulls %d, silent %d, seed %u, EDC/ECC %s\n",
+           spec.streams, spec.stride, spec.chunk, spec.sectorSize, spec.nulls, spec.silent, spec.seed, spec.edc ? "on" : "off");
+    printf("         Stage    Time (s)     MiB/s   Sectors/s  Peak RSS (MiB)\n");
+    for (const Stage &stage : stages)
+    {
+        printf("  %12s  %10.4f  %8.1f  %10.0f  %14.1f\n", stage.name, stage.seconds, stage.bytes / (1024 * 1024) / stage.seconds,
+               stage.sectors / stage.seconds, stage.rss / (1024.0 * 1024));
+    }
+    printf(" Round-trip: %s\n", ok ? "OK" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Runs the round-trip over every stride, chunk mix, sector size and EDC/ECC setting, one line each.
+static int benchSweep(const int streams, const uint32_t seed)
+{
+    int failed = 0;
+    printf("Stride Chunk  Size  EDC  interleave  analysis  deinterleave  replace (MiB/s)  Peak RSS (MiB)\n");
+    for (int stride = 2; stride <= 32; stride *= 2)
+    {
+        for (int chunk : {1, 7})
+        {
+            if (chunk > 1 && stride < 8)
+                continue;
+            for (int sectorSize : {XA_DATA_SIZE, 2352})
+            {
+                for (bool edc : {false, true})
+                {
+                    std::vector<Stage> stages;
+                    const ArchiveSpec spec{streams, stride, sectorSize, chunk, 20, 0, seed, edc};
+                    const bool ok = roundTrip(spec, stages);
+                    failed += !ok;
+
+                    printf("%6d %5d %5d %4s", stride, chunk, sectorSize, edc ? "on" : "off");
+                    for (size_t i = 0; i < 4; ++i)
+                    {
+                        if (i < stages.size())
+                            printf(i == 0 ? "  %10.1f" : i == 1 ? "  %8.1f" : i == 2 ? "  %12.1f" : "  %15.1f", stages[i].bytes / (1024 * 1024) / stages[i].seconds);
+                        else
+                            printf(i == 0 ? "  %10s" : i == 1 ? "  %8s" : i == 2 ? "  %12s" : "  %15s", "-");
+                    }
+                    printf("  %14.1f  %s\n", stages.empty() ? 0.0 : stages.back().rss / (1024.0 * 1024), ok ? "OK" : "FAILED");
+                }
+            }
+        }
+    }
+
+    // Silence-only streams are dropped by the analysis, and interleaved back from their sources
+    std::vector<Stage> stages;
+    const bool ok = roundTrip({streams, 8, XA_DATA_SIZE, 1, 20, std::max(streams / 8, 1), seed, false}, stages);
+    failed += !ok;
+    printf("Silent streams: %s\n", ok ? "OK" : "FAILED");
+
+    printf("%d configuration(s) failed.\n", failed);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+    {
+        printf("xa-bench " VER " by N4gtan\n\n"
+               " Usage: xa-bench classify [sectors] [iterations]\n"
+               "        xa-bench edc [sectors] [iterations]\n"
+               "        xa-bench roundtrip [streams] [stride] [size] [chunk] [nulls] [silent] [seed] [edc]\n"
+               "        xa-bench sweep [streams] [seed]\n\n"
+               "  classify: Times the sector classifier kernel against the memcmp loop\n"
+               "       edc: Times the EDC/ECC regeneration against a bit at a time CRC\n"
+               " roundtrip: Times analysis, deinterleave, interleave and replace on a synthetic archive and checks that\n"
+               "            every stream deinterleaves back, interleaves back to the same bytes and survives an identity replace\n"
+               "     sweep: Runs roundtrip for every stride (2-32), chunk mix (1/7), sector size (2336/2352) and EDC/ECC (off/on)\n"
+               "   Sectors: Optional number of synthetic sectors. Defaults to 4096\n"
+               "Iterations: Optional number of passes over the sectors. Defaults to 200 (20 for edc)\n"
+               "   Streams: Optional number of streams in the archive. Defaults to 32\n"
+               "    Stride: Optional stride of the archive (2/4/8/16/32). Defaults to 8\n"
+               "      Size: Optional sector size of the archive (2336 or 2352). Defaults to 2336\n"
+               "     Chunk: Optional chunk of every other stream, 1 for all audio or 7 for video. Defaults to 1\n"
+               "     Nulls: Optional longest null trailing run of every third stream. Defaults to 20\n"
+               "    Silent: Optional number of silence-only streams. Defaults to 0\n"
+               "      Seed: Optional seed of the generator. Defaults to 1\n"
+               "       EDC: Optional 1 to regenerate the EDC/ECC when interleaving, like xa-interleaver. Defaults to 0\n");
+        return EXIT_SUCCESS;
+    }
+
+    if (strcmp(argv[1], "classify") == 0)
+    {
+        const size_t sectorCount = argc >= 3 ? strtoul(argv[2], nullptr, 10) : 4096;
+        const int iterations = argc >= 4 ? atoi(argv[3]) : 200;
+        return benchClassify(sectorCount, iterations);
+    }
+
+    if (strcmp(argv[1], "edc") == 0)
+    {
+        const size_t sectorCount = argc >= 3 ? strtoul(argv[2], nullptr, 10) : 4096;
+        const int iterations = argc >= 4 ? atoi(argv[3]) : 20;
+        return benchEdc(sectorCount, iterations);
+    }
+
+    if (strcmp(argv[1], "roundtrip") == 0)
+    {
+        ArchiveSpec spec{32, 8, XA_DATA_SIZE, 1, 20, 0, 1, false};
+        spec.streams = argc >= 3 ? atoi(argv[2]) : spec.streams;
+        spec.stride = argc >= 4 ? atoi(argv[3]) : spec.stride;
+        spec.sectorSize = argc >= 5 ? atoi(argv[4]) : spec.sectorSize;
+        spec.chunk = argc >= 6 ? atoi(argv[5]) : spec.chunk;
+        spec.nulls = argc >= 7 ? atoi(argv[6]) : spec.nulls;
+        spec.silent = argc >= 8 ? atoi(argv[7]) : spec.silent;
+        spec.seed = argc >= 9 ? strtoul(argv[8], nullptr, 10) : spec.seed;
+        spec.edc = argc >= 10 ? atoi(argv[9]) != 0 : spec.edc;
+        if (spec.streams < 1 || (spec.stride & (spec.stride - 1)) != 0 || spec.stride < 2 || spec.stride > 32 ||
+            (spec.sectorSize != XA_DATA_SIZE && spec.sectorSize != 2352) || spec.chunk < 1 || spec.nulls < 0 || spec.silent < 0)
+        {
+            fprintf(stderr, "Error: Invalid archive parameters.\n");
+            return EXIT_FAILURE;
+        }
+        return benchRoundTrip(spec);
+    }
+
+    if (strcmp(argv[1], "sweep") == 0)
+    {
+        const int streams = argc >= 3 ? atoi(argv[2]) : 32;
+        const uint32_t seed = argc >= 4 ? strtoul(argv[3], nullptr, 10) : 1;
+        return benchSweep(std::max(streams, 1), seed);
+    }
+
+    fprintf(stderr, "Error: Unknown benchmark \"%s\".\n", argv[1]);
+    return EXIT_FAILURE;
+}
@@ -6,20 +6,50 @@ int main(int argc, char *argv[])
     if (argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
     {
         printf("xa-deinterleaver " VER " by N4gtan\n\n"
-               " Usage: xa-deinterleaver <input> [size] [output]\n\n"
+               " Usage: xa-deinterleaver <input> [size] [output] [jobs]\n\n"
                " Input: XA interleaved file\n"
+               "        Or a .bin/.img/.cue CD image, to only scan the .XA/.STR files of its ISO9660 filesystem\n"
                "  Size: Optional output file sector size (2336 or 2352). Defaults to input file sector size\n"
-               "Output: Optional output directory path. Defaults to input file path\n");
+               "Output: Optional output directory path. Defaults to input file path\n"
+               "  Jobs: Optional number of files written in parallel (0 = all cores). Defaults to 1\n");
         return EXIT_SUCCESS;
     }
 
     const std::filesystem::path inputFile = argv[1];
     const int sectorSize = argc >= 3 ? atoi(argv[2]) : 0;
     const std::filesystem::path outputDir = argc >= 4 ? argv[3] : inputFile.parent_path() / inputFile.stem();
+    const int jobs = argc >= 5 ? atoi(argv[4]) : 1;
 
-    deinterleaver(inputFile).deinterleave(outputDir, sectorSize);
-    if (errno)
-        return EXIT_FAILURE;
+    const iso9660 image(inputFile);
+    if (!image.imagePath.empty())
+    {
+        // Every file of the image is analyzed and deinterleaved on its own, within its extent,
+        // into a directory that mirrors its path in the image, so files with the same name do not overwrite each other
+        size_t foundFiles = 0;
+        bool failed = false;
+        for (const iso9660::Extent &extent : image.extents)
+        {
+            errno = 0;
+            deinterleaver files(image.imagePath, extent);
+            if (errno)
+                return EXIT_FAILURE;
+            if (!files.entries.empty())
+                foundFiles++;
+            failed |= !files.deinterleave(outputDir / std::filesystem::u8path(extent.filePath), sectorSize, jobs);
+        }
+        printf("Streams found in %zu of %zu .XA/.STR files.\n", foundFiles, image.extents.size());
+        if (failed)
+            return EXIT_FAILURE;
+    }
+    else
+    {
+        errno = 0;
+        deinterleaver files(inputFile);
+        if (errno)
+            return EXIT_FAILURE;
+        if (!files.deinterleave(outputDir, sectorSize, jobs))
+            return EXIT_FAILURE;
+    }
 
     printf("Process complete.\n");
 
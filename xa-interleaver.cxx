@@ -6,17 +6,24 @@ int main(int argc, char *argv[])
     if (argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
     {
         printf("xa-interleaver " VER " by N4gtan\n\n"
-               " Usage: xa-interleaver <input> [stride] [size] [output]\n\n"
+               " Usage: xa-interleaver <input> [stride] [size] [output] [edc]\n\n"
                " Input: Manifest .csv file (or any text file with the appropriate format)\n"
                "Stride: Optional stride of sectors to interleave (2/4/8/16/32). Defaults to 8\n"
                "  Size: Optional output file sector size (2336 or 2352). Defaults to first file sector size\n"
-               "Output: Optional output file path. Defaults to input file path\n");
+               "Output: Optional output file path. Defaults to input file path\n"
+               "   Edc: Optional 1 to regenerate the EDC/ECC of the output sectors. Defaults to 0\n");
         return EXIT_SUCCESS;
     }
 
     const std::filesystem::path inputFile = argv[1];
     const int sectorStride = argc >= 3 ? atoi(argv[2]) : 8;
     const int sectorSize = argc >= 4 ? atoi(argv[3]) : 0;
+    const bool regenerateEdc = argc >= 6 && atoi(argv[5]) != 0;
+    if (sectorSize != 0 && sectorSize != 2336 && sectorSize != 2352)
+    {
+        fprintf(stderr, "Error: Invalid sector size %d. It must be 2336 or 2352\n", sectorSize);
+        return EXIT_FAILURE;
+    }
 
     interleaver files(inputFile, sectorStride);
     if (files.entries.empty())
@@ -36,7 +43,7 @@ int main(int argc, char *argv[])
     std::unique_ptr<char[]> stdoBuf(new char[1024 * 1024]);
     setvbuf(outputFile, stdoBuf.get(), _IOFBF, 1024 * 1024);
 
-    files.interleave(outputFile, sectorSize);
+    files.interleave(outputFile, sectorSize, regenerateEdc);
     fclose(outputFile);
 
     printf("Process complete.\n");
@@ -1,4 +1,4 @@
-#include "libxa_deinterleaver.hxx"
+#include "libxa_replacer.hxx"
 
 #define VER "VERSION"
 #define XA_DATA_SIZE 2336
@@ -10,7 +10,7 @@ int check_file(FILE *fp, const std::filesystem::path &path, uintmax_t &fileSize,
     if (!fp)
     {
         fprintf(stderr, "Error: Cannot open file \"%s\".\n", path.filename().string().c_str());
-        exit(1);
+        return 0;
     }
 
     fileSize = std::filesystem::file_size(path);
@@ -23,7 +23,53 @@ int check_file(FILE *fp, const std::filesystem::path &path, uintmax_t &fileSize,
     }
 
     fprintf(stderr, "Error: File \"%s\" is not aligned to 2336/2352 bytes.\n", path.filename().string().c_str());
-    exit(EXIT_FAILURE);
+    return 0;
+}
+
+// Reads "source,sector" lines or a xa-deinterleaver manifest (8 fields, file at the 3rd and sector_beg-end at the 7th).
+// Any other line is an error, so nothing is written.
+bool read_manifest(const std::filesystem::path &path, std::vector<std::pair<std::filesystem::path, int>> &lines)
+{
+    std::unique_ptr<FILE, decltype(&fclose)> manifest(fopen(path.string().c_str(), "r"), &fclose);
+    if (!manifest)
+    {
+        fprintf(stderr, "Error: Cannot read \"%s\". %s\n", path.filename().string().c_str(), strerror(errno));
+        return false;
+    }
+
+    bool valid = true;
+    char line[1024];
+    for (int lineNum = 1; fgets(line, sizeof(line), manifest.get()); ++lineNum)
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0 || line[0] == '#' || strncmp(line, "chunk,", 6) == 0)
+            continue;
+
+        std::vector<std::string> fields;
+        for (const char *field = line;; ++field)
+        {
+            const char *end = strchr(field, ',');
+            fields.emplace_back(field, end ? end - field : strlen(field));
+            if (!(field = end))
+                break;
+        }
+
+        // Interleaver manifest lines have 7 fields or less and no sectors, so they are not taken for either.
+        int sector, endSector, length = -1;
+        const std::string *file = fields.size() == 8 ? &fields[2] : fields.size() == 2 ? &fields[0] : nullptr;
+        if (file && fields.size() == 8)
+            sscanf(fields[6].c_str(), "%d-%d%n", &sector, &endSector, &length);
+        else if (file)
+            sscanf(fields[1].c_str(), "%d%n", &sector, &length);
+        if (!file || file->empty() || length < 0 || static_cast<size_t>(length) != fields[fields.size() == 8 ? 6 : 1].size())
+        {
+            fprintf(stderr, "Error: Line %d of \"%s\". Expected \"source,sector\" or a xa-deinterleaver manifest line.\n", lineNum, path.filename().string().c_str());
+            valid = false;
+            continue;
+        }
+        lines.emplace_back(path.parent_path() / std::filesystem::u8path(*file), sector);
+    }
+    return valid;
 }
 
 int main(int argc, char *argv[])
@@ -33,7 +79,10 @@ int main(int argc, char *argv[])
         printf("xa-replacer " VER " by N4gtan\n\n"
                " Usage: xa-replacer <target> <source> [sector]\n\n"
                "Target: File to be modified (in-place)\n"
+               "        Or a .bin/.img/.cue CD image, to only scan the .XA/.STR files of its ISO9660 filesystem\n"
                "Source: Deinterleaved XA file to inject\n"
+               "        Or a .csv/.txt manifest to replace many streams at once, with \"source,sector\" lines\n"
+               "        or the manifest written by xa-deinterleaver\n"
                "Sector: Starting LBA of the track to replace\n"
                "        (If omitted, a track list will be displayed to choose from)\n");
         return EXIT_SUCCESS;
@@ -41,107 +90,158 @@ int main(int argc, char *argv[])
 
     const std::filesystem::path tgtPath = argv[1];
     const std::filesystem::path srcPath = argv[2];
+    std::string srcExt = srcPath.extension().string();
+    std::transform(srcExt.begin(), srcExt.end(), srcExt.begin(), [](unsigned char c) { return std::tolower(c); });
+    const bool batch = srcExt == ".csv" || srcExt == ".txt";
+
+    // A CD image gets an analysis for each of its .XA/.STR files, the rest of the image is never scanned
+    const iso9660 image(tgtPath);
+    const bool isImage = !image.imagePath.empty();
+    std::vector<std::unique_ptr<deinterleaver>> targets;
+    for (size_t i = 0; i < (isImage ? image.extents.size() : 1); ++i)
+    {
+        errno = 0;
+        targets.emplace_back(isImage ? new deinterleaver(image.imagePath, image.extents[i]) : new deinterleaver(tgtPath));
+        if (errno)
+            return EXIT_FAILURE;
+    }
 
-    const std::vector<deinterleaver::FileInfo> entries = std::move(deinterleaver(tgtPath).entries);
-    if (errno)
-        return EXIT_FAILURE;
+    std::vector<deinterleaver::FileInfo> entries;
+    std::vector<size_t> owners; // Index of the targets entry of each stream
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+        entries.insert(entries.end(), targets[i]->entries.begin(), targets[i]->entries.end());
+        owners.resize(entries.size(), i);
+    }
 
-    const auto &entry = [&]() -> const deinterleaver::FileInfo &
+    // Pairs of source file and starting LBA of the stream to replace
+    std::vector<std::pair<std::filesystem::path, int>> requests;
+    if (batch)
     {
-        if (argc >= 4)
+        if (!read_manifest(srcPath, requests))
+            return EXIT_FAILURE;
+        if (requests.empty())
         {
-            int sector = 0;
-            const int ret = sscanf(argv[3], "%d", &sector);
-            const auto it = std::find_if(entries.begin(), entries.end(), [sector](const auto &entry) { return entry.begSec == sector; });
-            if (ret == 0 || it == entries.end())
-            {
-                fprintf(stderr, "Error: There is no stream that starts at sector %s.\n", argv[3]);
-                exit(EXIT_FAILURE);
-            }
-            return *it;
+            fprintf(stderr, "Error: There is nothing to replace in \"%s\".\n", srcPath.filename().string().c_str());
+            return EXIT_FAILURE;
         }
-        else
+    }
+    else if (argc >= 4)
+    {
+        int sector = 0;
+        if (sscanf(argv[3], "%d", &sector) == 0)
         {
-            size_t track = 0;
-            printf("Track AudioSectors NullSectors Beg-End_AudioSector\n");
-            for (const auto &entry : entries)
-                printf("#%-5zu%-13d%-12d%d-%d\n", track++, entry.sectorCount, entry.nullTrailing, entry.begSec, entry.endSec);
-
-            printf("Enter track number: #");
-            const int ret = scanf("%zu", &track);
-            if (ret == 0 || track >= entries.size())
-            {
-                fprintf(stderr, "Error: That was not a valid track.\n");
-                exit(EXIT_FAILURE);
-            }
-            return entries[track];
+            fprintf(stderr, "Error: There is no stream that starts at sector %s.\n", argv[3]);
+            return EXIT_FAILURE;
+        }
+        requests.emplace_back(srcPath, sector);
+    }
+    else
+    {
+        size_t track = 0;
+        printf("Track AudioSectors NullSectors Beg-End_AudioSector\n");
+        for (const auto &entry : entries)
+        {
+            if (isImage && (track == 0 || owners[track] != owners[track - 1]))
+                printf("%s:\n", image.extents[owners[track]].filePath.c_str());
+            printf("#%-5zu%-13d%-12d%d-%d\n", track++, entry.sectorCount, entry.nullTrailing, entry.begSec, entry.endSec);
         }
-    }();
+
+        printf("Enter track number: #");
+        const int ret = scanf("%zu", &track);
+        if (ret == 0 || track >= entries.size())
+        {
+            fprintf(stderr, "Error: That was not a valid track.\n");
+            return EXIT_FAILURE;
+        }
+        requests.emplace_back(srcPath, entries[track].begSec);
+        getchar(); // Consume the new line of the track number
+    }
 
     uint8_t buffer[CD_SECTOR_SIZE] {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
-    std::unique_ptr<FILE, decltype(&fclose)> tgtFile(fopen(tgtPath.string().c_str(), "r+b"), &fclose);
-    std::unique_ptr<FILE, decltype(&fclose)> srcFile(fopen(srcPath.string().c_str(), "rb"), &fclose);
+    const std::filesystem::path tgtFilePath = isImage ? image.imagePath : tgtPath;
+    std::unique_ptr<FILE, decltype(&fclose)> tgtFile(fopen(tgtFilePath.string().c_str(), "r+b"), &fclose);
 
     // Retrieve sector sizes and offsets
-    uintmax_t tgtSize, srcSize;
-    const int tgtSectorSize = check_file(tgtFile.get(), tgtPath, tgtSize, buffer);
-    const int srcSectorSize = check_file(srcFile.get(), srcPath, srcSize, buffer);
-    const int dataOffset    = tgtSectorSize  - XA_DATA_SIZE;
-    const int buffOffset    = CD_SECTOR_SIZE - srcSectorSize;
-
-    // Validate target available space
-    const int srcSectorCount = srcSize / srcSectorSize;
-    if (srcSectorCount > entry.sectorCount + entry.nullTrailing)
-    {
-        fprintf(stderr, "Error: Source exceeds target stream size by %d sector(s).\n", srcSectorCount - (entry.sectorCount + entry.nullTrailing));
+    uintmax_t tgtSize;
+    const int tgtSectorSize = check_file(tgtFile.get(), tgtFilePath, tgtSize, buffer);
+    if (tgtSectorSize == 0)
         return EXIT_FAILURE;
-    }
-
-    // Check eof bit and reset file pointers
-    fseeko(tgtFile.get(), static_cast<int64_t>(entry.endSec) * tgtSectorSize + dataOffset + 2, SEEK_SET);
-    uint8_t eofBit = fgetc(tgtFile.get()) & 0x80;
-    fseeko(srcFile.get(), 0, SEEK_SET);
-    fseeko(tgtFile.get(), static_cast<int64_t>(entry.begSec) * tgtSectorSize + dataOffset, SEEK_SET);
+    const int dataOffset = tgtSectorSize - XA_DATA_SIZE;
 
-    // Write data
-    auto processSector = [&](auto tag) -> void
-    {
-        [[maybe_unused]] size_t __ = fread(buffer + buffOffset, 1, srcSectorSize, srcFile.get());
-        buffer[SUBHEAD_OFFSET + 4] = buffer[SUBHEAD_OFFSET]     = entry.filenum;
-        buffer[SUBHEAD_OFFSET + 5] = buffer[SUBHEAD_OFFSET + 1] = entry.channel;
-        if constexpr (tag)
-            buffer[SUBHEAD_OFFSET + 6] = buffer[SUBHEAD_OFFSET + 2] = (buffer[SUBHEAD_OFFSET + 2] & 0x7F) | eofBit;
-        fwrite(buffer + SUBHEAD_OFFSET, 1, XA_DATA_SIZE, tgtFile.get());
-    };
-
-    const int skipSize = entry.sectorStride * tgtSectorSize + dataOffset;
-    for (int i = 1; i < srcSectorCount; ++i)
+    // Validate every replacement before writing anything
+    bool valid = true;
+    std::vector<replacer::Replacement> replacements;
+    std::vector<bool> usedStreams(entries.size());
+    for (const auto &[path, sector] : requests)
     {
-        processSector(std::false_type{});
-        fseeko(tgtFile.get(), skipSize, SEEK_CUR);
-    }
-    processSector(std::true_type{});
+        const auto it = std::find_if(entries.begin(), entries.end(), [sector = sector](const auto &entry) { return entry.begSec == sector; });
+        if (it == entries.end())
+        {
+            fprintf(stderr, "Error: There is no stream that starts at sector %d.\n", sector);
+            valid = false;
+            continue;
+        }
+        if (usedStreams[it - entries.begin()])
+        {
+            fprintf(stderr, "Error: The stream that starts at sector %d is replaced more than once.\n", sector);
+            valid = false;
+            continue;
+        }
+        usedStreams[it - entries.begin()] = true;
+        const deinterleaver::FileInfo &entry = *it;
 
-    // Null filler
-    int sectorsToFill = entry.sectorCount - srcSectorCount;
-    if (sectorsToFill > 0)
-    {
-        printf("Warning: Source is smaller than target stream size by %d sector(s).\n"
-               "         Write null sector(s) as filler? <Y/n> ", sectorsToFill);
+        uintmax_t srcSize;
+        std::unique_ptr<FILE, decltype(&fclose)> srcFile(fopen(path.string().c_str(), "rb"), &fclose);
+        const int srcSectorSize = check_file(srcFile.get(), path, srcSize, buffer);
+        if (srcSectorSize == 0)
+        {
+            valid = false;
+            continue;
+        }
 
-        const uint8_t key = getchar();
-        if (std::tolower(key) != 'n')
+        // Validate target available space
+        const int srcSectorCount = srcSize / srcSectorSize;
+        if (srcSectorCount > entry.sectorCount + entry.nullTrailing)
         {
-            memcpy(&buffer[SUBHEAD_OFFSET], &entry.nullSubheader, sizeof(entry.nullSubheader));
-            memcpy(&buffer[SUBHEAD_OFFSET + 4], &entry.nullSubheader, sizeof(entry.nullSubheader));
-            memset(&buffer[SUBHEAD_OFFSET + 8], entry.nullSubheader[2] == 0xFF ? 0xFF : 0, sizeof(buffer) - (SUBHEAD_OFFSET + 8));
-            while (sectorsToFill-- > 0)
+            fprintf(stderr, "Error: Source \"%s\" exceeds target stream size by %d sector(s).\n", path.filename().string().c_str(),
+                    srcSectorCount - (entry.sectorCount + entry.nullTrailing));
+            valid = false;
+            continue;
+        }
+
+        // Check eof bit
+        fseeko(tgtFile.get(), static_cast<int64_t>(entry.endSec) * tgtSectorSize + dataOffset + 2, SEEK_SET);
+        const uint8_t eofBit = fgetc(tgtFile.get()) & 0x80;
+
+        // Null filler
+        int sectorsToFill = entry.sectorCount - srcSectorCount;
+        if (sectorsToFill > 0)
+        {
+            if (batch)
+                printf("Warning: Source \"%s\" is smaller than target stream size by %d sector(s). Filled with null sectors.\n",
+                       path.filename().string().c_str(), sectorsToFill);
+            else
             {
-                fseeko(tgtFile.get(), skipSize, SEEK_CUR);
-                fwrite(buffer + SUBHEAD_OFFSET, 1, XA_DATA_SIZE, tgtFile.get());
+                printf("Warning: Source is smaller than target stream size by %d sector(s).\n"
+                       "         Write null sector(s) as filler? <Y/n> ", sectorsToFill);
+
+                const uint8_t key = getchar();
+                if (std::tolower(key) == 'n')
+                    sectorsToFill = 0;
             }
         }
+        replacements.push_back({path, &entry, targets[owners[it - entries.begin()]].get(), srcSectorSize, srcSectorCount, std::max(sectorsToFill, 0), eofBit});
     }
+    if (!valid)
+        return EXIT_FAILURE;
+
+    replacer::apply(tgtFile.get(), tgtSectorSize, tgtSize / tgtSectorSize, replacements);
+
+    // Keep the sidecar index of the target in sync without analyzing it again
+    tgtFile.reset();
+    for (const auto &target : targets)
+        target->refreshIndex();
 
     printf("Process complete.\n");
     return EXIT_SUCCESS;